@@ -2,19 +2,31 @@
 
 #include <cstdint>
 
+#if defined(_WIN32)
 #if BUILDING_SIMPLEGUI
 #define SIMPLEGUI_API __declspec(dllexport)
 #else
 #define SIMPLEGUI_API __declspec(dllimport)
 #endif
+#else
+#define SIMPLEGUI_API __attribute__((visibility("default")))
+#endif
 
 namespace simplegui
 {
 	class KeyListener;
 	class WindowListener;
+	class FrameListener;
 	class Painter;
+	class Font;
+	class Image;
+	class SpriteAtlas;
 	class Graphics;
+	class DisplayList;
 	class Window;
+	class HeadlessWindow;
+	class SceneNode;
+	class Scene;
 
 	//! \brief Listens for key events.
 	class SIMPLEGUI_API KeyListener
@@ -48,6 +60,60 @@ namespace simplegui
 		int mod; // modifier keys held, one of MOD_*
 	};
 
+	//! \brief A mouse position reported to a window.
+	struct MouseSample
+	{
+		int x, y; // position
+		double time; // seconds, only differences between samples are meaningful
+	};
+
+	//! \brief The keyboard and mouse state of a window at one instant.
+	struct InputState
+	{
+		uint32_t keys[8]; // bit vk % 32 of keys[vk / 32] is set while key vk is pressed
+		uint32_t mbuttons; // bit mb - 1 is set while mouse button mb is pressed
+		int mod; // modifier keys held, combination of MOD_*
+		int x, y; // last mouse position reported to the window
+
+		//! \brief Get the state of a key.
+		//! 
+		//! \param [in] vk The virtual key code.
+		//! 
+		//! \return true if the key is pressed and false otherwise.
+		bool IsKeyDown(int vk) const
+		{
+			return vk >= 0 && vk < 256 && ((keys[vk >> 5] >> (vk & 31)) & 1);
+		}
+
+		//! \brief Get the state of a mouse button.
+		//! 
+		//! \param [in] mb The mouse button (1, 2, 3, ...).
+		//! 
+		//! \return true if the mouse button is pressed and false otherwise.
+		bool IsMouseButtonDown(int mb) const
+		{
+			return mb >= 1 && mb <= 16 && ((mbuttons >> (mb - 1)) & 1);
+		}
+	};
+
+	//! \brief A key, mouse or window event recorded in a window's event
+	//! queue.
+	struct Event
+	{
+		int type; // one of EVENT_*
+		int x, y; // mouse position, or the new size or position of the window
+		int code; // key, scan code, mouse button or scroll amount
+		int mod; // modifier keys held, combination of MOD_*
+	};
+
+	//! \brief Counters of a window's event queue.
+	struct EventQueueStats
+	{
+		uint64_t queued; // events added to the queue
+		uint64_t dropped; // events lost because the queue was full
+		uint64_t coalesced; // events merged into a newer one because the queue was full
+	};
+
 	//! \brief Listens for mouse events.
 	class SIMPLEGUI_API MouseListener
 	{
@@ -59,6 +125,15 @@ namespace simplegui
 		//! \param [in] y The new y position.
 		virtual void MouseMoved(Window *win, int x, int y);
 
+		//! \brief Called with every mouse position reported since the last
+		//! call, oldest first, when the window batches mouse moves. By
+		//! default, calls MouseMoved() with the latest position.
+		//! 
+		//! \param [in] win The window.
+		//! \param [in] samples The positions. Only valid during the call.
+		//! \param [in] count The number of positions, at least 1.
+		virtual void MouseMovedBatch(Window *win, const MouseSample *samples, int count);
+
 		//! \brief Called when a mouse button has been pressed.
 		//! 
 		//! \param [in] win The window.
@@ -118,6 +193,19 @@ namespace simplegui
 		virtual void WindowMoved(Window *win, int x, int y);
 	};
 
+	//! \brief Listens for frames.
+	class SIMPLEGUI_API FrameListener
+	{
+	public:
+		//! \brief Called at the start of every frame, before the window is
+		//! painted. Update animations and invalidate what changed here.
+		//! 
+		//! \param [in] win The window.
+		//! \param [in] dt Seconds elapsed since the previous frame, measured
+		//! with a monotonic clock.
+		virtual void Update(Window *win, double dt);
+	};
+
 	//! \brief Paints a window.
 	class SIMPLEGUI_API Painter
 	{
@@ -225,7 +313,7 @@ namespace simplegui
 		//! \brief Convert the color to an ARGB color code.
 		//! 
 		//! \return An ARGB color code.
-		constexpr uint32_t ToARGB()
+		constexpr uint32_t ToARGB() const
 		{
 			return 
 				((abgr & 0x000000ff) << 16) |
@@ -269,10 +357,286 @@ namespace simplegui
 		return a.abgr == b.abgr;
 	}
 
+	//! \brief A rectangle.
+	struct Rect
+	{
+		int x, y; // top left corner
+		int w, h; // size
+	};
+
+	//! \brief A point.
+	struct Point
+	{
+		int x, y; // position
+	};
+
+	//! \brief A rectangle drawn with its own color by Graphics::FillRects()
+	//! and Graphics::FillEllipses().
+	struct ColorRect
+	{
+		int x, y; // top left corner
+		int w, h; // size
+		Color color; // line and fill color
+	};
+
+	//! \brief A line drawn with its own color by Graphics::DrawLines().
+	struct ColorLine
+	{
+		int x1, y1; // start
+		int x2, y2; // end, not drawn
+		Color color; // line color
+	};
+
+	//! \brief Counters of a graphics context.
+	struct GraphicsStats
+	{
+		uint64_t stateChanges; // color and mode changes passed on to the backend
+		uint64_t stateChangesElided; // changes dropped because they would not change anything
+	};
+
+	//! \brief Counters of a scene.
+	struct SceneStats
+	{
+		uint64_t nodes; // nodes in the scene, besides the root
+		uint64_t painted; // nodes drawn by the last paint
+	};
+
+	//! \brief Vertical and horizontal measurements of a font, in pixels.
+	struct FontMetrics
+	{
+		int ascent; // height above the baseline
+		int descent; // depth below the baseline
+		int height; // height of a line of text, ascent plus descent
+		int lineHeight; // vertical distance between lines
+		int averageAdvance; // average horizontal distance between glyphs
+		int maxAdvance; // largest horizontal distance between glyphs
+	};
+
+	//! \brief A font text is drawn with. Fonts are measured once, when they
+	//! are first used, and keep a table of advance widths, so measuring text
+	//! does not need a graphics context and may be done from any thread.
+	//! Fonts are owned by the library.
+	class SIMPLEGUI_API Font
+	{
+	public:
+		//! \brief Get the built-in bitmap font of the software rasterizer,
+		//! used by graphics contexts in memory, headless windows and double
+		//! buffered windows.
+		//! 
+		//! \return The font.
+		static Font *GetBuiltin();
+
+		//! \brief Get the font windows draw text with when they are not
+		//! double buffered. Same as the built-in font where the platform has
+		//! no windowing system.
+		//! 
+		//! \return The font.
+		static Font *GetSystem();
+	public:
+		Font();
+		virtual ~Font();
+
+		//! \brief Get the measurements of the font.
+		//! 
+		//! \param [out] metrics Receives the measurements.
+		virtual void GetMetrics(FontMetrics *const metrics) = 0;
+
+		//! \brief Get the horizontal distance from a character to the next.
+		//! 
+		//! \param [in] ch The character.
+		//! 
+		//! \return The advance width, in pixels.
+		virtual int GetAdvance(unsigned char ch) = 0;
+
+		//! \brief Measure the extent of text as drawn by DrawString(). Line
+		//! breaks start new lines.
+		//! 
+		//! \param [in] string The text.
+		//! \param [out] w Receives the width of the widest line. Optional.
+		//! \param [out] h Receives the height of all lines. Optional.
+		virtual void MeasureString(const char *string, int *const w, int *const h) = 0;
+	};
+
+	//! \brief A 32-bit image with pixels stored as 0xAARRGGBB, rows top to
+	//! bottom. The pixels are accessed directly, without copying.
+	class SIMPLEGUI_API Image
+	{
+	public:
+		//! \brief Create an image which owns its pixels, initially
+		//! transparent black. Destroy the image through the delete operator.
+		//! 
+		//! \param [in] width The width, in pixels.
+		//! \param [in] height The height, in pixels.
+		//! 
+		//! \return The image.
+		static Image *Create(int width, int height);
+
+		//! \brief Create an image which uses existing pixels without copying
+		//! them, such as a frame decoded by a video library. Changes to the
+		//! pixels show up the next time the image is drawn. Destroy the image
+		//! through the delete operator.
+		//! 
+		//! \param [in] pixels The pixels. The image does not own these.
+		//! \param [in] width The width, in pixels.
+		//! \param [in] height The height, in pixels.
+		//! \param [in] stride The distance between rows, in pixels.
+		//! 
+		//! \return The image.
+		static Image *Wrap(uint32_t *pixels, int width, int height, int stride);
+	public:
+		Image();
+		virtual ~Image();
+
+		//! \brief Get the pixels.
+		//! 
+		//! \return The top left pixel.
+		virtual uint32_t *GetPixels() = 0;
+
+		//! \brief Get the width.
+		//! 
+		//! \return The width, in pixels.
+		virtual int GetWidth() = 0;
+
+		//! \brief Get the height.
+		//! 
+		//! \return The height, in pixels.
+		virtual int GetHeight() = 0;
+
+		//! \brief Get the distance between rows.
+		//! 
+		//! \return The stride, in pixels.
+		virtual int GetStride() = 0;
+	};
+
+	//! \brief Where to draw a sprite of an atlas.
+	struct SpriteInstance
+	{
+		int sprite; // index returned by SpriteAtlas::Add()
+		int x, y; // top left corner
+	};
+
+	//! \brief Many small images packed into one surface, drawn in batches
+	//! with Graphics::DrawSprites().
+	class SIMPLEGUI_API SpriteAtlas
+	{
+	public:
+		//! \brief Create an empty atlas. Destroy the atlas through the delete
+		//! operator.
+		//! 
+		//! \param [in] width The width of the surface, in pixels.
+		//! \param [in] height The height of the surface, in pixels.
+		//! 
+		//! \return The atlas.
+		static SpriteAtlas *Create(int width, int height);
+	public:
+		SpriteAtlas();
+		virtual ~SpriteAtlas();
+
+		//! \brief Copy an image into the atlas.
+		//! 
+		//! \param [in] image The image. The atlas does not keep it.
+		//! 
+		//! \return The index of the sprite, or -1 if the atlas has no room
+		//! for it.
+		virtual int Add(Image *image) = 0;
+
+		//! \brief Get the surface the sprites are packed into.
+		//! 
+		//! \return The surface.
+		virtual Image *GetImage() = 0;
+
+		//! \brief Get where a sprite is in the surface.
+		//! 
+		//! \param [in] sprite The index of the sprite.
+		//! \param [out] rect Receives the location and size of the sprite.
+		//! 
+		//! \return false if there is no such sprite.
+		virtual bool GetSprite(int sprite, Rect *const rect) = 0;
+
+		//! \brief Get the number of sprites.
+		//! 
+		//! \return The number of sprites.
+		virtual int GetSpriteCount() = 0;
+	};
+
+	//! \brief Counters of a frame stream.
+	struct FrameStreamStats
+	{
+		uint64_t published; // frames published by the producer
+		uint64_t presented; // frames taken for presenting
+		uint64_t dropped; // frames replaced by a newer one before being presented
+	};
+
+	//! \brief Hands frames from a producer thread to a window without copying
+	//! and without waiting. The producer writes the next frame in place and
+	//! publishes it; the window presents the latest published frame.
+	//! Frames published faster than they are presented are dropped, so
+	//! latency does not build up.
+	//! 
+	//! One thread produces frames and one thread, usually the window's,
+	//! presents them.
+	class SIMPLEGUI_API FrameStream
+	{
+	public:
+		//! \brief Create a frame stream with its own buffers. Destroy the
+		//! stream through the delete operator, after removing it from any
+		//! window.
+		//! 
+		//! \param [in] width The width of the frames, in pixels.
+		//! \param [in] height The height of the frames, in pixels.
+		//! \param [in] buffers The number of buffers, 2 or 3. With three,
+		//! the producer never has to skip a frame. With two, BeginFrame()
+		//! fails until the last published frame has been presented.
+		//! 
+		//! \return The frame stream.
+		static FrameStream *Create(int width, int height, int buffers);
+	public:
+		FrameStream();
+		virtual ~FrameStream();
+
+		//! \brief Get the buffer to write the next frame into. Producer only.
+		//! Returns the same buffer until it is published.
+		//! 
+		//! \return The buffer, or null if none is free, in which case the
+		//! frame should be skipped. The contents are those of an older frame.
+		virtual Image *BeginFrame() = 0;
+
+		//! \brief Publish the frame written since BeginFrame(). Producer only.
+		//! Replaces the previously published frame if it has not been
+		//! presented yet, and repaints the window presenting the stream.
+		virtual void PublishFrame() = 0;
+
+		//! \brief Get the latest published frame. Consumer only. The frame
+		//! stays valid until the next call.
+		//! 
+		//! \return The frame, or null if none has been published yet.
+		virtual Image *AcquireFrame() = 0;
+
+		//! \brief Get the counters.
+		//! 
+		//! \param [out] stats Receives the counters.
+		virtual void GetStats(FrameStreamStats *const stats) = 0;
+	};
+
 	//! \brief A graphics context.
-	class Graphics
+	class SIMPLEGUI_API Graphics
 	{
 	public:
+		//! \brief Create a graphics context which renders into a 32-bit
+		//! framebuffer in memory. Pixels are stored as 0xAARRGGBB. Destroy
+		//! the context through the delete operator.
+		//! 
+		//! \param [in] pixels The framebuffer. The context does not own this.
+		//! \param [in] width The width of the framebuffer, in pixels.
+		//! \param [in] height The height of the framebuffer, in pixels.
+		//! \param [in] stride The distance between rows, in pixels.
+		//! 
+		//! \return The graphics context.
+		static Graphics *Create(uint32_t *pixels, int width, int height, int stride);
+	public:
+		Graphics();
+		virtual ~Graphics();
+
 		//! \brief Draw a rectangle.
 		//! 
 		//! \param [in] x The x coordinate.
@@ -289,7 +653,7 @@ namespace simplegui
 		//! \param [in] h The height.
 		virtual void FillRect(int x, int y, int w, int h) = 0;
 
-		//! \brief Draw an ellipse.
+		//! \brief Draw the outline of an ellipse with the line color.
 		//! 
 		//! \param [in] x The x coordinate.
 		//! \param [in] y The y coordinate.
@@ -297,7 +661,8 @@ namespace simplegui
 		//! \param [in] h The height.
 		virtual void DrawEllipse(int x, int y, int w, int h) = 0;
 
-		//! \brief Fill an ellipse.
+		//! \brief Fill an ellipse with the fill color, outlined with the line
+		//! color.
 		//! 
 		//! \param [in] x The x coordinate.
 		//! \param [in] y The y coordinate.
@@ -320,13 +685,129 @@ namespace simplegui
 		//! \param [in] text The text to draw.
 		virtual void DrawString(int x, int y, const char *string) = 0;
 
-		//! \brief Set the clipping rectangle.
+		//! \brief Draw an image at its own size. With BLEND_NONE the pixels
+		//! are copied, with BLEND_SOURCE_OVER they are blended by their alpha.
+		//! The default implementation draws it scaled to its own size.
+		//! 
+		//! \param [in] image The image.
+		//! \param [in] x The x coordinate.
+		//! \param [in] y The y coordinate.
+		virtual void DrawImage(Image *image, int x, int y);
+
+		//! \brief Draw an image scaled to a rectangle. The default
+		//! implementation draws nothing.
+		//! 
+		//! \param [in] image The image.
+		//! \param [in] x The x coordinate.
+		//! \param [in] y The y coordinate.
+		//! \param [in] w The width to scale to.
+		//! \param [in] h The height to scale to.
+		//! \param [in] filter One of FILTER_*.
+		virtual void DrawImage(Image *image, int x, int y, int w, int h, int filter);
+
+		//! \brief Draw sprites of an atlas at their own size, like DrawImage()
+		//! for each of them but in a single call. The default implementation
+		//! calls DrawImage() for each of them.
+		//! 
+		//! \param [in] atlas The atlas.
+		//! \param [in] instances The sprites and where to draw them, in
+		//! drawing order. Instances with invalid sprites are skipped.
+		//! \param [in] count The number of instances.
+		virtual void DrawSprites(SpriteAtlas *atlas, const SpriteInstance *instances, int count);
+
+		//! \brief Fill rectangles, like FillRect() for each of them but in a
+		//! single call. Each rectangle is outlined and filled with its own
+		//! color. The current colors are left unchanged. The default
+		//! implementation calls SetColor() and FillRect() for each of them,
+		//! then restores the colors if GetColors() knows them.
+		//! 
+		//! \param [in] rects The rectangles, in drawing order.
+		//! \param [in] count The number of rectangles.
+		virtual void FillRects(const ColorRect *rects, int count);
+
+		//! \brief Fill ellipses, like FillEllipse() for each of them but in a
+		//! single call. Each ellipse is outlined and filled with its own
+		//! color. The current colors are left unchanged. The default
+		//! implementation calls SetColor() and FillEllipse() for each of them,
+		//! then restores the colors if GetColors() knows them.
+		//! 
+		//! \param [in] ellipses The bounding boxes of the ellipses, in drawing
+		//! order.
+		//! \param [in] count The number of ellipses.
+		virtual void FillEllipses(const ColorRect *ellipses, int count);
+
+		//! \brief Draw lines, like DrawLine() for each of them but in a single
+		//! call. Each line is drawn with its own color. The current colors are
+		//! left unchanged. The default implementation calls SetLineColor() and
+		//! DrawLine() for each of them, then restores the line color if
+		//! GetColors() knows it.
+		//! 
+		//! \param [in] lines The lines, in drawing order.
+		//! \param [in] count The number of lines.
+		virtual void DrawLines(const ColorLine *lines, int count);
+
+		//! \brief Draw connected lines through a series of points with the
+		//! line color. Every point but the last is drawn exactly once, so
+		//! joints are not blended twice. The default implementation calls
+		//! DrawLine() for each segment, so joints are drawn as DrawLine()
+		//! draws end points.
+		//! 
+		//! \param [in] points The points.
+		//! \param [in] count The number of points. Nothing is drawn with less
+		//! than two.
+		virtual void DrawPolyline(const Point *points, int count);
+
+		//! \brief Draw connected lines through a dense series of points,
+		//! such as a time series with more points than there are pixel
+		//! columns. Consecutive points in the same column are merged into
+		//! the first, lowest, highest and last of them before the lines are
+		//! drawn with DrawPolyline(), so the lines drawn depend on the width
+		//! covered rather than the number of points. With opaque colors the
+		//! result is identical to DrawPolyline() with all points.
+		//! 
+		//! \param [in] points The points, usually in increasing x order.
+		//! \param [in] count The number of points. Nothing is drawn with less
+		//! than two.
+		virtual void DrawSeries(const Point *points, int count);
+
+		//! \brief Get the font DrawString() draws with. The default
+		//! implementation returns the built-in font.
+		//! 
+		//! \return The font.
+		virtual Font *GetFont();
+
+		//! \brief Measure the extent of text as drawn by DrawString(), with
+		//! the font returned by GetFont().
+		//! 
+		//! \param [in] string The text.
+		//! \param [out] w Receives the width. Optional.
+		//! \param [out] h Receives the height. Optional.
+		virtual void MeasureString(const char *string, int *const w, int *const h);
+
+		//! \brief Set the clipping rectangle. Nothing is drawn outside of it.
+		//! The rectangle replaces the current clipping rectangle, but stays
+		//! within the one saved by the last call to PushClipRect().
 		//! 
 		//! \param [in] x The x position.
 		//! \param [in] y The y position.
 		//! \param [in] w The width.
 		//! \param [in] h The height.
 		virtual void SetClipRect(int x, int y, int w, int h) = 0;
+
+		//! \brief Save the current clipping rectangle and clip to its
+		//! intersection with another rectangle. Restore it with PopClipRect().
+		//! The default implementation keeps the pushed rectangles itself and
+		//! clips through SetClipRect(), starting from no clipping.
+		//! 
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		//! \param [in] w The width.
+		//! \param [in] h The height.
+		virtual void PushClipRect(int x, int y, int w, int h);
+
+		//! \brief Restore the clipping rectangle saved by the last call to
+		//! PushClipRect(). Does nothing if there is none.
+		virtual void PopClipRect();
 		
 		//! \brief Set the line color.
 		//! 
@@ -364,11 +845,128 @@ namespace simplegui
 		//! \param [in] color The color.
 		virtual void SetColor(Color color) = 0;
 
+		//! \brief Get the current line and fill colors, as last set. The
+		//! default implementation does not know them.
+		//! 
+		//! \param [out] line Receives the line color. Optional.
+		//! \param [out] fill Receives the fill color. Optional.
+		//! 
+		//! \return false if the colors are not known.
+		virtual bool GetColors(Color *const line, Color *const fill);
+
+		//! \brief Set how colors are combined with what is already drawn.
+		//! With BLEND_NONE, the default, the alpha component of colors is
+		//! ignored and everything is drawn opaque. With BLEND_SOURCE_OVER,
+		//! the alpha component is the opacity, from 0 (transparent) to 255
+		//! (opaque), and colors set through components without an alpha are
+		//! opaque. Only the software rasterizer blends, used by graphics
+		//! contexts in memory, headless windows and double buffered windows;
+		//! other contexts ignore the mode.
+		//! 
+		//! \param [in] mode One of BLEND_*.
+		virtual void SetBlendMode(int mode);
+
+		//! \brief Set whether lines are anti-aliased. Anti-aliased lines
+		//! cover two pixels across, each blended by how much of it the line
+		//! covers, also with BLEND_NONE. Off by default. Only the software
+		//! rasterizer anti-aliases; other contexts ignore the setting.
+		//! 
+		//! \param [in] enabled Whether lines are anti-aliased.
+		virtual void SetAntialiasing(bool enabled);
+
 		//! \brief Clear the space.
 		virtual void Clear() = 0;
 
 		//! \brief Dispose of internal resources. Does not free this object.
 		virtual void Dispose() = 0;
+
+		//! \brief Get the region which needs to be repainted. Drawing outside
+		//! of this region has no effect.
+		//! 
+		//! \param [out] rects An array which receives the rectangles making up
+		//! the region. The rectangles do not overlap. Optional.
+		//! \param [in] count The number of elements in rects.
+		//! 
+		//! \return The number of rectangles in the region, which may be larger
+		//! than count. If 0, the context does not track a region and
+		//! everything should be considered dirty.
+		virtual int GetDirtyRects(Rect *const rects, int count);
+
+		//! \brief Test whether a rectangle intersects the region which needs
+		//! to be repainted. Use this to skip building content which would not
+		//! be visible.
+		//! 
+		//! \param [in] x The x coordinate.
+		//! \param [in] y The y coordinate.
+		//! \param [in] w The width.
+		//! \param [in] h The height.
+		//! 
+		//! \return true if the rectangle needs to be repainted and false
+		//! otherwise.
+		virtual bool IsDirty(int x, int y, int w, int h);
+
+		//! \brief Get the counters of the context, which start at 0 when it
+		//! is created. Setting a color or mode which is already current is
+		//! not passed on to the backend, so painters can set the colors of
+		//! every primitive without paying for redundant changes. The default
+		//! implementation reports no changes.
+		//! 
+		//! \param [out] stats Receives the counters.
+		virtual void GetStats(GraphicsStats *const stats);
+	private:
+		struct ClipStack;
+		ClipStack *clips; // used by the default PushClipRect() and PopClipRect()
+
+		Graphics(const Graphics &) = delete;
+		Graphics &operator=(const Graphics &) = delete;
+	};
+
+	//! \brief A graphics context which records drawing commands into a
+	//! compact buffer instead of drawing them. The recorded commands can be
+	//! replayed onto any other graphics context any number of times, so
+	//! static content only has to be built once.
+	class SIMPLEGUI_API DisplayList : public Graphics
+	{
+	public:
+		//! \brief Create an empty display list. Destroy the display list
+		//! through the delete operator.
+		//! 
+		//! \return The display list.
+		static DisplayList *Create();
+	public:
+		//! \brief Draw the recorded commands onto a graphics context. Images
+		//! are recorded by reference and must stay alive as long as the
+		//! commands are replayed.
+		//! 
+		//! \param [in] g The graphics context to draw onto.
+		virtual void Replay(Graphics *g) = 0;
+
+		//! \brief Draw the recorded commands onto a graphics context, on
+		//! several threads when it renders into memory, like the contexts of
+		//! Graphics::Create(), headless windows and double buffered windows.
+		//! The context is split into tiles of whole rows, each command is
+		//! binned into the tiles it touches, and the tiles are rasterized in
+		//! parallel. The pixels are the same as with Replay(). Other contexts
+		//! are drawn on the calling thread.
+		//! 
+		//! \param [in] g The graphics context to draw onto.
+		//! \param [in] threads The maximum number of threads, including the
+		//! calling one, or 0 for one per processor.
+		virtual void Replay(Graphics *g, int threads) = 0;
+
+		//! \brief Discard all recorded commands so the display list can be
+		//! recorded again. Does not release the command buffer.
+		virtual void Reset() = 0;
+
+		//! \brief Returns whether no commands have been recorded.
+		//! 
+		//! \return true if the display list is empty and false otherwise.
+		virtual bool IsEmpty() = 0;
+
+		//! \brief Get the number of recorded commands.
+		//! 
+		//! \return The number of commands.
+		virtual int GetCommandCount() = 0;
 	};
 
 	//! \brief Provides an interface to a Window.
@@ -383,6 +981,18 @@ namespace simplegui
 		//! 
 		//! \return The window.
 		static Window *Create(int width, int height, const char *title);
+
+		//! \brief Set how many event-loop threads service windows. By default,
+		//! every window runs its own thread. When count is positive, windows
+		//! created afterwards share a pool of at most count threads instead,
+		//! so the number of threads no longer grows with the number of
+		//! windows. Each new window joins the least loaded thread, and child
+		//! windows join the thread of their parent. Existing windows keep
+		//! their thread.
+		//!
+		//! \param [in] count The number of shared threads, or 0 to give each
+		//! window its own thread.
+		static void SetSharedThreads(int count);
 	public:
 		Window();
 		virtual ~Window();
@@ -442,6 +1052,41 @@ namespace simplegui
 		//! \brief Invalidate the window, which will trigger a repaint in the future.
 		virtual void Invalidate() = 0;
 
+		//! \brief Invalidate part of the window, which will trigger a repaint
+		//! of that part in the future. Invalidated rectangles accumulate until
+		//! the next paint and are exposed through Graphics::GetDirtyRects().
+		//! 
+		//! \param [in] x The x coordinate.
+		//! \param [in] y The y coordinate.
+		//! \param [in] w The width.
+		//! \param [in] h The height.
+		virtual void Invalidate(int x, int y, int w, int h) = 0;
+
+		//! \brief Enable or disable double buffering. When enabled, the painter
+		//! draws into a persistent offscreen surface through the software
+		//! rasterizer, and only the dirty region is copied to the window in a
+		//! single blit. The background is not erased. This removes flicker from
+		//! animated content. Disabled by default.
+		//! 
+		//! \param [in] enabled Whether to double buffer.
+		virtual void SetDoubleBuffered(bool enabled) = 0;
+
+		//! \brief Present a frame stream in the window. Every paint draws
+		//! the latest frame scaled to the client area, before the painter
+		//! runs, and publishing a frame repaints the window.
+		//! 
+		//! \param [in] stream The stream, created by FrameStream::Create().
+		//! The window does not own this. Null, or a stream implemented
+		//! elsewhere, removes the current stream.
+		virtual void SetFrameStream(FrameStream *stream) = 0;
+
+		//! \brief Get the font the graphics context passed to the painter
+		//! draws text with, which depends on whether the window is double
+		//! buffered. Use it to lay out text outside of painting.
+		//! 
+		//! \return The font.
+		virtual Font *GetFont() = 0;
+
 		//! \brief Validate the window.
 		virtual void Validate() = 0;
 
@@ -483,6 +1128,84 @@ namespace simplegui
 		//! removes the current listener.
 		virtual void SetPainter(Painter *p) = 0;
 
+		//! \brief Set or remove the frame listener.
+		//! 
+		//! \param [in] fl The frame listener. The window does not own this.
+		//! Null removes the current listener.
+		virtual void SetFrameListener(FrameListener *fl) = 0;
+
+		//! \brief Set the target frame rate. When positive, the window runs
+		//! frames at that rate: each frame calls the frame listener and then
+		//! repaints whatever was invalidated since the previous frame, so any
+		//! number of invalidations between frames cost a single paint. When 0,
+		//! the default, the window paints on demand as soon as it is
+		//! invalidated, calling the frame listener before each paint.
+		//! 
+		//! \param [in] fps The number of frames per second, or 0 to paint on
+		//! demand.
+		virtual void SetFrameRate(double fps) = 0;
+
+		//! \brief Set how mouse moves are delivered to the mouse listener.
+		//! With MOUSE_MOVE_IMMEDIATE, the default, MouseMoved() is called for
+		//! every position the system reports. With MOUSE_MOVE_COALESCED,
+		//! positions are collected and MouseMoved() is called once with the
+		//! latest one, at the start of the next frame when a frame rate is set,
+		//! otherwise once pending input has been handled. MOUSE_MOVE_BATCHED
+		//! collects positions the same way but hands all of them, with
+		//! timestamps, to MouseMovedBatch(), including the ones the system
+		//! merged while the window was busy. Pending moves are always delivered
+		//! before a mouse button or scroll event.
+		//! 
+		//! \param [in] mode One of MOUSE_MOVE_*.
+		virtual void SetMouseMoveMode(int mode) = 0;
+
+		//! \brief Queue events instead of calling the listeners from the
+		//! event thread. Events are recorded into a bounded lock-free queue
+		//! which one thread of your choosing drains with PollEvents() or
+		//! DispatchEvents(), so slow listeners no longer stall the window.
+		//! When the queue is full, mouse moves and window size, position and
+		//! close events are coalesced so only the latest of each kind is kept
+		//! until there is room. Other events are dropped with
+		//! EVENT_QUEUE_DROP, or make the event thread wait with
+		//! EVENT_QUEUE_BLOCK, in which case the queue must not be drained
+		//! from a painter or frame listener. The capacity is fixed by the
+		//! first call which enables the queue; later calls change the
+		//! overflow policy or turn queueing off and on.
+		//! 
+		//! \param [in] capacity The number of events the queue holds, rounded
+		//! up to a power of two, or 0 to call the listeners directly again.
+		//! \param [in] overflow One of EVENT_QUEUE_*.
+		virtual void SetEventQueue(int capacity, int overflow) = 0;
+
+		//! \brief Take events from the event queue. Only one thread may take
+		//! events at a time.
+		//! 
+		//! \param [out] events Receives the events, oldest first.
+		//! \param [in] count The maximum number of events to take.
+		//! \param [in] timeout Milliseconds to wait for an event if the queue
+		//! is empty, 0 to return immediately or -1 to wait until an event
+		//! arrives or the window is disposed.
+		//! 
+		//! \return The number of events taken.
+		virtual int PollEvents(Event *const events, int count, int timeout) = 0;
+
+		//! \brief Take all events from the event queue and call the
+		//! listeners for them on the calling thread. A closing event disposes
+		//! of the window if there is no window listener. Only one thread may
+		//! take events at a time.
+		//! 
+		//! \param [in] timeout Milliseconds to wait for an event if the queue
+		//! is empty, 0 to return immediately or -1 to wait until an event
+		//! arrives or the window is disposed.
+		//! 
+		//! \return The number of events dispatched.
+		virtual int DispatchEvents(int timeout) = 0;
+
+		//! \brief Get the counters of the event queue.
+		//! 
+		//! \param [out] stats Receives the counters.
+		virtual void GetEventQueueStats(EventQueueStats *const stats) = 0;
+
 		//! \brief Get the state of a key in this window.
 		//! 
 		//! \param [in] vk The virtual key code.
@@ -523,6 +1246,15 @@ namespace simplegui
 		//! \param [out] y The y position of the mouse. Optional.
 		virtual void GetAsyncMousePosition(int *const x, int *const y) = 0;
 
+		//! \brief Get the state of all keys, mouse buttons and modifier keys
+		//! and the mouse position at once. The state is consistent: it never
+		//! mixes input from before and after an event. Like the other
+		//! GetAsync* functions this does not take a lock, so it is cheap to
+		//! poll from another thread.
+		//! 
+		//! \param [out] state Receives the state.
+		virtual void GetInputState(InputState *const state) = 0;
+
 		//! \brief Create a child window.
 		//! 
 		//! \param [in] width The width of the window.
@@ -533,6 +1265,326 @@ namespace simplegui
 		virtual Window *CreateChild(int width, int height, const char *title) = 0;
 	};
 
+	//! \brief A window which renders into a framebuffer in memory instead of
+	//! the screen. No event thread is created: painting and listener calls
+	//! happen synchronously on the thread which calls into the window, and
+	//! input is injected through the Inject* functions.
+	class SIMPLEGUI_API HeadlessWindow : public Window
+	{
+	public:
+		//! \brief Create a headless window. Destroy the window through the
+		//! delete operator.
+		//! 
+		//! \param [in] width The width of the framebuffer.
+		//! \param [in] height The height of the framebuffer.
+		//! \param [in] title The title of the window. Optional.
+		//! 
+		//! \return The window.
+		static HeadlessWindow *Create(int width, int height, const char *title);
+	public:
+		//! \brief Run a frame: deliver coalesced mouse moves, call the frame
+		//! listener, then paint the window if it has been invalidated since
+		//! the last paint. If a frame rate is
+		//! set, the frame listener receives a fixed time step of 1 / fps
+		//! seconds so runs are reproducible, otherwise the measured time.
+		//! 
+		//! \return true if the window was painted and false otherwise.
+		virtual bool Flush() = 0;
+
+		//! \brief Get the framebuffer. Pixels are stored as 0xAARRGGBB. The
+		//! pointer is invalidated when the window is resized.
+		//! 
+		//! \param [out] w The width of the framebuffer. Optional.
+		//! \param [out] h The height of the framebuffer. Optional.
+		//! \param [out] stride The distance between rows, in pixels. Optional.
+		//! 
+		//! \return The framebuffer.
+		virtual const uint32_t *GetPixels(int *const w, int *const h, int *const stride) = 0;
+
+		//! \brief Get the number of times the window has been painted.
+		//! 
+		//! \return The number of frames painted.
+		virtual uint64_t GetFrameCount() = 0;
+
+		//! \brief Simulate a key being pressed.
+		//! 
+		//! \param [in] vk The key.
+		virtual void InjectKeyDown(int vk) = 0;
+
+		//! \brief Simulate a character being typed.
+		//! 
+		//! \param [in] scancode The scan code of the key typed.
+		virtual void InjectKeyTyped(unsigned int scancode) = 0;
+
+		//! \brief Simulate a key being released.
+		//! 
+		//! \param [in] vk The key.
+		virtual void InjectKeyUp(int vk) = 0;
+
+		//! \brief Simulate the mouse moving.
+		//! 
+		//! \param [in] x The new x position.
+		//! \param [in] y The new y position.
+		virtual void InjectMouseMove(int x, int y) = 0;
+
+		//! \brief Simulate a mouse button being pressed.
+		//! 
+		//! \param [in] mb The mouse button (1, 2, 3, ...).
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		virtual void InjectMouseDown(int mb, int x, int y) = 0;
+
+		//! \brief Simulate a mouse button being released.
+		//! 
+		//! \param [in] mb The mouse button (1, 2, 3, ...).
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		virtual void InjectMouseUp(int mb, int x, int y) = 0;
+
+		//! \brief Simulate the mouse scrolling.
+		//! 
+		//! \param [in] amount The amount of scroll.
+		virtual void InjectMouseScroll(int amount) = 0;
+
+		//! \brief Simulate the user closing the window.
+		virtual void InjectClose() = 0;
+
+		//! \brief Simulate the window gaining or losing focus.
+		//! 
+		//! \param [in] focused Whether the window has focus.
+		virtual void InjectFocus(bool focused) = 0;
+	};
+
+	//! \brief A node of a Scene: a rectangle, ellipse, text, image or a group
+	//! of other nodes. Positions are relative to the parent. Changing a node
+	//! invalidates the part of the window it covered before and covers
+	//! after. Nodes are owned by their scene; use Scene::Remove() instead of
+	//! deleting them.
+	class SIMPLEGUI_API SceneNode
+	{
+	public:
+		SceneNode();
+		virtual ~SceneNode();
+
+		//! \brief Get the type of the node.
+		//! 
+		//! \return One of NODE_*.
+		virtual int GetType() = 0;
+
+		//! \brief Get the group the node belongs to.
+		//! 
+		//! \return The parent, or null for the root.
+		virtual SceneNode *GetParent() = 0;
+
+		//! \brief Set the position of the node, relative to its parent.
+		//! 
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		virtual void SetPos(int x, int y) = 0;
+
+		//! \brief Get the position of the node, relative to its parent.
+		//! 
+		//! \param [out] x The x position. Optional.
+		//! \param [out] y The y position. Optional.
+		virtual void GetPos(int *const x, int *const y) = 0;
+
+		//! \brief Set the size of a rectangle, ellipse or image, which is
+		//! scaled to it. Ignored by other nodes.
+		//! 
+		//! \param [in] w The width.
+		//! \param [in] h The height.
+		virtual void SetSize(int w, int h) = 0;
+
+		//! \brief Set the color of a rectangle, ellipse or text. Ignored by
+		//! other nodes.
+		//! 
+		//! \param [in] color The color.
+		virtual void SetColor(Color color) = 0;
+
+		//! \brief Set the text of a text node. Ignored by other nodes.
+		//! 
+		//! \param [in] text The text, copied by the node.
+		virtual void SetText(const char *text) = 0;
+
+		//! \brief Set the image of an image node, resizing the node to the
+		//! image. Ignored by other nodes.
+		//! 
+		//! \param [in] image The image. The node does not own it, and it must
+		//! stay alive as long as the node is painted. Null draws nothing.
+		virtual void SetImage(Image *image) = 0;
+
+		//! \brief Show or hide the node. Hiding a group hides its children.
+		//! 
+		//! \param [in] visible Whether to show the node.
+		virtual void SetVisible(bool visible) = 0;
+
+		//! \brief Get the area of the window the node covers when it is
+		//! shown, which for groups is that of their visible children.
+		//! 
+		//! \param [out] rect Receives the bounds, in window coordinates.
+		virtual void GetBounds(Rect *const rect) = 0;
+	};
+
+	//! \brief A retained tree of nodes which paints a window. Install it as
+	//! the painter of the window. Changing, adding and removing nodes
+	//! invalidates only what they cover, and a paint draws only the nodes
+	//! intersecting the dirty region, found through a spatial index, in
+	//! tree order. Dirty areas are cleared first. Nodes may be changed from
+	//! any thread.
+	class SIMPLEGUI_API Scene : public Painter
+	{
+	public:
+		//! \brief Create an empty scene. Destroy the scene through the delete
+		//! operator, after removing it from the window.
+		//! 
+		//! \param [in] win The window the scene invalidates. The scene does
+		//! not own it and does not install itself as its painter.
+		//! 
+		//! \return The scene.
+		static Scene *Create(Window *win);
+	public:
+		Scene();
+		virtual ~Scene();
+
+		//! \brief Get the root group, positioned at the top left corner of
+		//! the window.
+		//! 
+		//! \return The root.
+		virtual SceneNode *GetRoot() = 0;
+
+		//! \brief Add a filled rectangle, drawn after the other children of
+		//! its parent.
+		//! 
+		//! \param [in] parent The group to add to, or null for the root.
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		//! \param [in] w The width.
+		//! \param [in] h The height.
+		//! \param [in] color The color.
+		//! 
+		//! \return The node, or null if the parent is not a group.
+		virtual SceneNode *AddRect(SceneNode *parent, int x, int y, int w, int h, Color color) = 0;
+
+		//! \brief Add a filled ellipse, drawn after the other children of its
+		//! parent.
+		//! 
+		//! \param [in] parent The group to add to, or null for the root.
+		//! \param [in] x The x position of the bounding box.
+		//! \param [in] y The y position of the bounding box.
+		//! \param [in] w The width of the bounding box.
+		//! \param [in] h The height of the bounding box.
+		//! \param [in] color The color.
+		//! 
+		//! \return The node, or null if the parent is not a group.
+		virtual SceneNode *AddEllipse(SceneNode *parent, int x, int y, int w, int h, Color color) = 0;
+
+		//! \brief Add text, drawn after the other children of its parent, with
+		//! the font of the window.
+		//! 
+		//! \param [in] parent The group to add to, or null for the root.
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		//! \param [in] text The text, copied by the node.
+		//! \param [in] color The color.
+		//! 
+		//! \return The node, or null if the parent is not a group.
+		virtual SceneNode *AddText(SceneNode *parent, int x, int y, const char *text, Color color) = 0;
+
+		//! \brief Add an image at its own size, drawn after the other children
+		//! of its parent.
+		//! 
+		//! \param [in] parent The group to add to, or null for the root.
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		//! \param [in] image The image. The node does not own it, and it must
+		//! stay alive as long as the node is painted.
+		//! 
+		//! \return The node, or null if the parent is not a group.
+		virtual SceneNode *AddImage(SceneNode *parent, int x, int y, Image *image) = 0;
+
+		//! \brief Add an empty group, drawn after the other children of its
+		//! parent.
+		//! 
+		//! \param [in] parent The group to add to, or null for the root.
+		//! \param [in] x The x position.
+		//! \param [in] y The y position.
+		//! 
+		//! \return The node, or null if the parent is not a group.
+		virtual SceneNode *AddGroup(SceneNode *parent, int x, int y) = 0;
+
+		//! \brief Remove a node and its children from the scene and destroy
+		//! them. The root cannot be removed.
+		//! 
+		//! \param [in] node The node.
+		virtual void Remove(SceneNode *node) = 0;
+
+		//! \brief Set the blend mode nodes are drawn with.
+		//! 
+		//! \param [in] mode One of BLEND_*.
+		virtual void SetBlendMode(int mode) = 0;
+
+		//! \brief Get the counters of the scene.
+		//! 
+		//! \param [out] stats Receives the counters.
+		virtual void GetStats(SceneStats *const stats) = 0;
+	};
+
+	/* blend modes, see Graphics::SetBlendMode() */
+	enum
+	{
+		BLEND_NONE,
+		BLEND_SOURCE_OVER
+	};
+
+	/* scene node types, see SceneNode::GetType() */
+	enum
+	{
+		NODE_GROUP,
+		NODE_RECT,
+		NODE_ELLIPSE,
+		NODE_TEXT,
+		NODE_IMAGE
+	};
+
+	/* image scaling filters, see Graphics::DrawImage() */
+	enum
+	{
+		FILTER_NEAREST,
+		FILTER_BILINEAR
+	};
+
+	/* mouse move delivery, see Window::SetMouseMoveMode() */
+	enum
+	{
+		MOUSE_MOVE_IMMEDIATE,
+		MOUSE_MOVE_COALESCED,
+		MOUSE_MOVE_BATCHED
+	};
+
+	/* event types, see Event */
+	enum
+	{
+		EVENT_KEY_DOWN, // code is the key
+		EVENT_KEY_TYPED, // code is the scan code
+		EVENT_KEY_UP, // code is the key
+		EVENT_MOUSE_MOVED, // x, y
+		EVENT_MOUSE_DOWN, // x, y, code is the button, mod
+		EVENT_MOUSE_UP, // x, y, code is the button, mod
+		EVENT_MOUSE_SCROLL, // code is the amount
+		EVENT_WINDOW_CLOSING,
+		EVENT_WINDOW_FOCUSED,
+		EVENT_WINDOW_UNFOCUSED,
+		EVENT_WINDOW_RESIZED, // x, y are the new size
+		EVENT_WINDOW_MOVED // x, y are the new position
+	};
+
+	/* event queue overflow policies, see Window::SetEventQueue() */
+	enum
+	{
+		EVENT_QUEUE_DROP,
+		EVENT_QUEUE_BLOCK
+	};
+
 	/* modifier keys */
 	enum
 	{
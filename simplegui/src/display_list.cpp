@@ -0,0 +1,670 @@
+#include <simplegui.h>
+
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include "memory_graphics.h"
+#include "raster.h"
+#include "sprite_atlas.h"
+#include "worker_pool.h"
+
+using namespace simplegui;
+
+//! \brief Recorded command opcodes
+enum Opcode : int32_t
+{
+	OP_DRAW_RECT, // x, y, w, h
+	OP_FILL_RECT, // x, y, w, h
+	OP_DRAW_ELLIPSE, // x, y, w, h
+	OP_FILL_ELLIPSE, // x, y, w, h
+	OP_DRAW_LINE, // x1, y1, x2, y2
+	OP_DRAW_STRING, // x, y, offset into string pool
+	OP_SET_CLIP_RECT, // x, y, w, h
+	OP_PUSH_CLIP_RECT, // x, y, w, h
+	OP_POP_CLIP_RECT,
+	OP_SET_LINE_COLOR, // abgr
+	OP_SET_FILL_COLOR, // abgr
+	OP_SET_COLOR, // abgr
+	OP_CLEAR,
+	OP_SET_BLEND_MODE, // mode
+	OP_DRAW_IMAGE, // x, y, index into image table
+	OP_DRAW_IMAGE_SCALED, // x, y, w, h, filter, index into image table
+	OP_DRAW_SPRITES, // index into atlas table, offset into sprite pool, count
+	OP_FILL_RECTS, // offset into shape pool, count
+	OP_FILL_ELLIPSES, // offset into shape pool, count
+	OP_DRAW_LINES, // offset into line pool, count
+	OP_DRAW_POLYLINE, // offset into point pool, count
+	OP_SET_ANTIALIASING // enabled
+};
+
+/* rows of the tiles rasterized in parallel by Replay() */
+static constexpr int TILE_ROWS = 32;
+
+//! \brief Display list stored as a flat buffer of 32-bit words
+class CommandList : public DisplayList
+{
+public:
+	std::vector<int32_t> commands; // opcode followed by its arguments
+	std::vector<char> strings; // null-terminated strings used by OP_DRAW_STRING
+	std::vector<Image *> images; // images used by OP_DRAW_IMAGE*, not owned
+	std::vector<SpriteAtlas *> atlases; // atlases used by OP_DRAW_SPRITES, not owned
+	std::vector<SpriteInstance> sprites; // instances used by OP_DRAW_SPRITES
+	std::vector<ColorRect> shapes; // rectangles used by OP_FILL_RECTS and OP_FILL_ELLIPSES
+	std::vector<ColorLine> lines; // lines used by OP_DRAW_LINES
+	std::vector<Point> points; // points used by OP_DRAW_POLYLINE
+	int count;
+
+	/* last recorded colors and modes, used to drop redundant changes */
+	bool hasLineColor, hasFillColor, hasBlendMode, hasAntialiasing;
+	uint32_t lineColor, fillColor;
+	int blendMode;
+	bool antialiasing;
+	GraphicsStats stats;
+
+	CommandList() :
+		count(0),
+		hasLineColor(false), hasFillColor(false), hasBlendMode(false), hasAntialiasing(false),
+		lineColor(0), fillColor(0), blendMode(0), antialiasing(false), stats()
+	{
+	}
+
+	virtual ~CommandList()
+	{
+		Dispose();
+	}
+
+	void Emit(Opcode op, int32_t a, int32_t b, int32_t c, int32_t d)
+	{
+		size_t n = commands.size();
+		commands.resize(n + 5);
+
+		int32_t *cmd = commands.data() + n;
+		cmd[0] = op;
+		cmd[1] = a;
+		cmd[2] = b;
+		cmd[3] = c;
+		cmd[4] = d;
+
+		count++;
+	}
+
+	void Emit(Opcode op, int32_t a)
+	{
+		commands.push_back(op);
+		commands.push_back(a);
+		count++;
+	}
+
+	void Emit(Opcode op)
+	{
+		commands.push_back(op);
+		count++;
+	}
+
+	virtual void DrawRect(int x, int y, int w, int h) override
+	{
+		Emit(OP_DRAW_RECT, x, y, w, h);
+	}
+
+	virtual void FillRect(int x, int y, int w, int h) override
+	{
+		Emit(OP_FILL_RECT, x, y, w, h);
+	}
+
+	virtual void DrawEllipse(int x, int y, int w, int h) override
+	{
+		Emit(OP_DRAW_ELLIPSE, x, y, w, h);
+	}
+
+	virtual void FillEllipse(int x, int y, int w, int h) override
+	{
+		Emit(OP_FILL_ELLIPSE, x, y, w, h);
+	}
+
+	virtual void DrawLine(int x1, int y1, int x2, int y2) override
+	{
+		Emit(OP_DRAW_LINE, x1, y1, x2, y2);
+	}
+
+	virtual void DrawString(int x, int y, const char *string) override
+	{
+		size_t offset = strings.size();
+		size_t len = strlen(string);
+
+		strings.insert(strings.end(), string, string + len + 1);
+
+		commands.push_back(OP_DRAW_STRING);
+		commands.push_back(x);
+		commands.push_back(y);
+		commands.push_back((int32_t)offset);
+		count++;
+	}
+
+	virtual void DrawImage(Image *image, int x, int y) override
+	{
+		commands.push_back(OP_DRAW_IMAGE);
+		commands.push_back(x);
+		commands.push_back(y);
+		commands.push_back((int32_t)images.size());
+		images.push_back(image);
+		count++;
+	}
+
+	virtual void DrawImage(Image *image, int x, int y, int w, int h, int filter) override
+	{
+		Emit(OP_DRAW_IMAGE_SCALED, x, y, w, h);
+		commands.push_back(filter);
+		commands.push_back((int32_t)images.size());
+		images.push_back(image);
+	}
+
+	virtual void DrawSprites(SpriteAtlas *atlas, const SpriteInstance *instances, int n) override
+	{
+		if (n <= 0) return;
+
+		commands.push_back(OP_DRAW_SPRITES);
+		commands.push_back((int32_t)atlases.size());
+		commands.push_back((int32_t)sprites.size());
+		commands.push_back(n);
+		count++;
+
+		/* the instances are copied, the atlas is referenced */
+		atlases.push_back(atlas);
+		sprites.insert(sprites.end(), instances, instances + n);
+	}
+
+	virtual void FillRects(const ColorRect *rects, int n) override
+	{
+		if (n <= 0) return;
+
+		commands.push_back(OP_FILL_RECTS);
+		commands.push_back((int32_t)shapes.size());
+		commands.push_back(n);
+		count++;
+
+		shapes.insert(shapes.end(), rects, rects + n);
+	}
+
+	virtual void FillEllipses(const ColorRect *ellipses, int n) override
+	{
+		if (n <= 0) return;
+
+		commands.push_back(OP_FILL_ELLIPSES);
+		commands.push_back((int32_t)shapes.size());
+		commands.push_back(n);
+		count++;
+
+		shapes.insert(shapes.end(), ellipses, ellipses + n);
+	}
+
+	virtual void DrawLines(const ColorLine *segments, int n) override
+	{
+		if (n <= 0) return;
+
+		commands.push_back(OP_DRAW_LINES);
+		commands.push_back((int32_t)lines.size());
+		commands.push_back(n);
+		count++;
+
+		lines.insert(lines.end(), segments, segments + n);
+	}
+
+	virtual void DrawPolyline(const Point *polyline, int n) override
+	{
+		if (n < 2) return;
+
+		commands.push_back(OP_DRAW_POLYLINE);
+		commands.push_back((int32_t)points.size());
+		commands.push_back(n);
+		count++;
+
+		points.insert(points.end(), polyline, polyline + n);
+	}
+
+	virtual void SetClipRect(int x, int y, int w, int h) override
+	{
+		Emit(OP_SET_CLIP_RECT, x, y, w, h);
+	}
+
+	virtual void PushClipRect(int x, int y, int w, int h) override
+	{
+		Emit(OP_PUSH_CLIP_RECT, x, y, w, h);
+	}
+
+	virtual void PopClipRect() override
+	{
+		Emit(OP_POP_CLIP_RECT);
+	}
+
+	virtual void SetLineColor(int r, int g, int b) override
+	{
+		SetLineColor(Color(r, g, b, 255));
+	}
+
+	virtual void SetLineColor(Color color) override
+	{
+		if (hasLineColor && lineColor == color.abgr)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
+
+		hasLineColor = true;
+		lineColor = color.abgr;
+		Emit(OP_SET_LINE_COLOR, (int32_t)color.abgr);
+		stats.stateChanges++;
+	}
+
+	virtual void SetFillColor(int r, int g, int b) override
+	{
+		SetFillColor(Color(r, g, b, 255));
+	}
+
+	virtual void SetFillColor(Color color) override
+	{
+		if (hasFillColor && fillColor == color.abgr)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
+
+		hasFillColor = true;
+		fillColor = color.abgr;
+		Emit(OP_SET_FILL_COLOR, (int32_t)color.abgr);
+		stats.stateChanges++;
+	}
+
+	virtual void SetColor(int r, int g, int b) override
+	{
+		SetColor(Color(r, g, b, 255));
+	}
+
+	virtual void SetColor(Color color) override
+	{
+		bool line = !hasLineColor || lineColor != color.abgr;
+		bool fill = !hasFillColor || fillColor != color.abgr;
+
+		if (line && fill)
+		{
+			hasLineColor = hasFillColor = true;
+			lineColor = fillColor = color.abgr;
+			Emit(OP_SET_COLOR, (int32_t)color.abgr);
+			stats.stateChanges++;
+		}
+		else if (line)
+			SetLineColor(color);
+		else if (fill)
+			SetFillColor(color);
+		else
+			stats.stateChangesElided++;
+	}
+
+	virtual bool GetColors(Color *const line, Color *const fill) override
+	{
+		/* unknown until both have been recorded, replay may start anywhere */
+		if (!hasLineColor || !hasFillColor)
+			return false;
+
+		if (line) line->abgr = lineColor;
+		if (fill) fill->abgr = fillColor;
+		return true;
+	}
+
+	virtual void SetBlendMode(int mode) override
+	{
+		if (hasBlendMode && blendMode == mode)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
+
+		hasBlendMode = true;
+		blendMode = mode;
+		Emit(OP_SET_BLEND_MODE, mode);
+		stats.stateChanges++;
+	}
+
+	virtual void SetAntialiasing(bool enabled) override
+	{
+		if (hasAntialiasing && antialiasing == enabled)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
+
+		hasAntialiasing = true;
+		antialiasing = enabled;
+		Emit(OP_SET_ANTIALIASING, enabled ? 1 : 0);
+		stats.stateChanges++;
+	}
+
+	virtual void Clear() override
+	{
+		Emit(OP_CLEAR);
+	}
+
+	virtual void Dispose() override
+	{
+		Reset();
+		commands.shrink_to_fit();
+		strings.shrink_to_fit();
+		images.shrink_to_fit();
+		atlases.shrink_to_fit();
+		sprites.shrink_to_fit();
+		shapes.shrink_to_fit();
+		lines.shrink_to_fit();
+		points.shrink_to_fit();
+	}
+
+	//! \brief Draw a single command.
+	//!
+	//! \param [in] g The graphics context to draw onto.
+	//! \param [in] cmd The command.
+	//!
+	//! \return The next command, or null if the buffer is corrupt.
+	const int32_t *Execute(Graphics *g, const int32_t *cmd) const
+	{
+		const char *pool = strings.data();
+
+		switch (cmd[0])
+		{
+		case OP_DRAW_RECT:
+			g->DrawRect(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_FILL_RECT:
+			g->FillRect(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_DRAW_ELLIPSE:
+			g->DrawEllipse(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_FILL_ELLIPSE:
+			g->FillEllipse(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_DRAW_LINE:
+			g->DrawLine(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_DRAW_STRING:
+			g->DrawString(cmd[1], cmd[2], pool + cmd[3]);
+			return cmd + 4;
+		case OP_SET_CLIP_RECT:
+			g->SetClipRect(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_PUSH_CLIP_RECT:
+			g->PushClipRect(cmd[1], cmd[2], cmd[3], cmd[4]);
+			return cmd + 5;
+		case OP_POP_CLIP_RECT:
+			g->PopClipRect();
+			return cmd + 1;
+		case OP_SET_LINE_COLOR: {
+			Color c;
+			c.abgr = (uint32_t)cmd[1];
+			g->SetLineColor(c);
+			return cmd + 2;
+		}
+		case OP_SET_FILL_COLOR: {
+			Color c;
+			c.abgr = (uint32_t)cmd[1];
+			g->SetFillColor(c);
+			return cmd + 2;
+		}
+		case OP_SET_COLOR: {
+			Color c;
+			c.abgr = (uint32_t)cmd[1];
+			g->SetColor(c);
+			return cmd + 2;
+		}
+		case OP_CLEAR:
+			g->Clear();
+			return cmd + 1;
+		case OP_SET_BLEND_MODE:
+			g->SetBlendMode(cmd[1]);
+			return cmd + 2;
+		case OP_SET_ANTIALIASING:
+			g->SetAntialiasing(cmd[1] != 0);
+			return cmd + 2;
+		case OP_DRAW_IMAGE:
+			g->DrawImage(images[cmd[3]], cmd[1], cmd[2]);
+			return cmd + 4;
+		case OP_DRAW_IMAGE_SCALED:
+			g->DrawImage(images[cmd[6]], cmd[1], cmd[2], cmd[3], cmd[4], cmd[5]);
+			return cmd + 7;
+		case OP_DRAW_SPRITES:
+			g->DrawSprites(atlases[cmd[1]], sprites.data() + cmd[2], cmd[3]);
+			return cmd + 4;
+		case OP_FILL_RECTS:
+			g->FillRects(shapes.data() + cmd[1], cmd[2]);
+			return cmd + 3;
+		case OP_FILL_ELLIPSES:
+			g->FillEllipses(shapes.data() + cmd[1], cmd[2]);
+			return cmd + 3;
+		case OP_DRAW_LINES:
+			g->DrawLines(lines.data() + cmd[1], cmd[2]);
+			return cmd + 3;
+		case OP_DRAW_POLYLINE:
+			g->DrawPolyline(points.data() + cmd[1], cmd[2]);
+			return cmd + 3;
+		default:
+			return nullptr; // corrupt buffer
+		}
+	}
+
+	//! \brief Find the rows a command draws to.
+	//!
+	//! \param [in] cmd The command.
+	//! \param [out] top Receives the first row, or INT_MIN for commands
+	//! which change state and have to be run for every row.
+	//! \param [out] bottom Receives one past the last row, or INT_MAX for
+	//! commands which change state.
+	//!
+	//! \return The next command, or null if the buffer is corrupt.
+	const int32_t *Rows(const int32_t *cmd, int *top, int *bottom) const
+	{
+		*top = INT_MIN;
+		*bottom = INT_MAX;
+
+		switch (cmd[0])
+		{
+		case OP_DRAW_RECT:
+			*top = cmd[2];
+			*bottom = cmd[2] + cmd[4] + 1;
+			return cmd + 5;
+		case OP_FILL_RECT:
+		case OP_DRAW_ELLIPSE:
+		case OP_FILL_ELLIPSE:
+			*top = cmd[2];
+			*bottom = cmd[2] + cmd[4];
+			return cmd + 5;
+		case OP_DRAW_LINE:
+			*top = cmd[2] < cmd[4] ? cmd[2] : cmd[4];
+			*bottom = (cmd[2] > cmd[4] ? cmd[2] : cmd[4]) + 1;
+			return cmd + 5;
+		case OP_DRAW_STRING: {
+			int h;
+			Font::GetBuiltin()->MeasureString(strings.data() + cmd[3], nullptr, &h);
+			*top = cmd[2];
+			*bottom = cmd[2] + h;
+			return cmd + 4;
+		}
+		case OP_SET_CLIP_RECT:
+		case OP_PUSH_CLIP_RECT:
+			return cmd + 5;
+		case OP_POP_CLIP_RECT:
+		case OP_CLEAR:
+			return cmd + 1;
+		case OP_SET_LINE_COLOR:
+		case OP_SET_FILL_COLOR:
+		case OP_SET_COLOR:
+		case OP_SET_BLEND_MODE:
+		case OP_SET_ANTIALIASING:
+			return cmd + 2;
+		case OP_DRAW_IMAGE:
+			*top = cmd[2];
+			*bottom = images[cmd[3]] ? cmd[2] + images[cmd[3]]->GetHeight() : cmd[2];
+			return cmd + 4;
+		case OP_DRAW_IMAGE_SCALED:
+			*top = cmd[2];
+			*bottom = cmd[2] + cmd[4];
+			return cmd + 7;
+		case OP_DRAW_SPRITES: {
+			*top = INT_MAX;
+			*bottom = INT_MIN;
+			if (!atlases[cmd[1]])
+				return cmd + 4;
+
+			SpriteTable table(atlases[cmd[1]]);
+			for (int i = 0; table.image && i < cmd[3]; i++)
+			{
+				const SpriteInstance &inst = sprites[cmd[2] + i];
+				const Rect *sprite = table.Find(inst.sprite);
+				if (!sprite)
+					continue;
+				if (inst.y < *top) *top = inst.y;
+				if (inst.y + sprite->h > *bottom) *bottom = inst.y + sprite->h;
+			}
+			return cmd + 4;
+		}
+		case OP_FILL_RECTS:
+		case OP_FILL_ELLIPSES:
+			*top = INT_MAX;
+			*bottom = INT_MIN;
+			for (int i = 0; i < cmd[2]; i++)
+			{
+				const ColorRect &rc = shapes[cmd[1] + i];
+				if (rc.y < *top) *top = rc.y;
+				if (rc.y + rc.h > *bottom) *bottom = rc.y + rc.h;
+			}
+			return cmd + 3;
+		case OP_DRAW_LINES:
+			*top = INT_MAX;
+			*bottom = INT_MIN;
+			for (int i = 0; i < cmd[2]; i++)
+			{
+				const ColorLine &ln = lines[cmd[1] + i];
+				int t = ln.y1 < ln.y2 ? ln.y1 : ln.y2;
+				int b = (ln.y1 > ln.y2 ? ln.y1 : ln.y2) + 1;
+				if (t < *top) *top = t;
+				if (b > *bottom) *bottom = b;
+			}
+			return cmd + 3;
+		case OP_DRAW_POLYLINE:
+			*top = INT_MAX;
+			*bottom = INT_MIN;
+			for (int i = 0; i < cmd[2]; i++)
+			{
+				const Point &pt = points[cmd[1] + i];
+				if (pt.y < *top) *top = pt.y;
+				if (pt.y + 1 > *bottom) *bottom = pt.y + 1;
+			}
+			return cmd + 3;
+		default:
+			return nullptr;
+		}
+	}
+
+	virtual void Replay(Graphics *g) override
+	{
+		const int32_t *cmd = commands.data();
+		const int32_t *end = cmd + commands.size();
+
+		while (cmd && cmd < end)
+			cmd = Execute(g, cmd);
+	}
+
+	virtual void Replay(Graphics *g, int threads) override
+	{
+		WorkerPool *pool = WorkerPool::Get();
+		if (threads <= 0 || threads > pool->GetThreadCount())
+			threads = pool->GetThreadCount();
+
+		/* tiles cost more in total than drawing at once, they only pay off
+		on several threads */
+		MemoryGraphics *target = dynamic_cast<MemoryGraphics *>(g);
+		if (!target || !target->pixels || threads == 1 || target->height <= TILE_ROWS)
+		{
+			Replay(g);
+			return;
+		}
+
+		/* bin the commands into tiles of whole rows. Commands which change
+		state go into every tile, so every tile sees the same state as the
+		serial replay */
+		int tiles = (target->height + TILE_ROWS - 1) / TILE_ROWS;
+		std::vector<std::vector<int32_t>> bins(tiles);
+
+		const int32_t *cmd = commands.data();
+		const int32_t *end = cmd + commands.size();
+		while (cmd < end)
+		{
+			int top, bottom;
+			const int32_t *next = Rows(cmd, &top, &bottom);
+			if (!next)
+				break;
+
+			int first = top <= 0 ? 0 : top / TILE_ROWS;
+			int last = bottom >= target->height ? tiles - 1 : (bottom - 1) / TILE_ROWS;
+			for (int i = first; top < bottom && bottom > 0 && i <= last; i++)
+				bins[i].push_back((int32_t)(cmd - commands.data()));
+
+			cmd = next;
+		}
+
+		/* the state after the last command, the same in every tile */
+		MemoryGraphics result(target->pixels, target->width, target->height, target->stride);
+
+		ResolveKernels();
+		pool->Run(tiles, threads, [&](int i)
+		{
+			/* each tile draws the commands in recorded order, restricted to
+			its rows, so the pixels are the same as drawing them serially */
+			MemoryGraphics tile(target->pixels, target->width, target->height, target->stride);
+			tile.CopyState(*target);
+
+			DirtyRegion region = target->dirty;
+			region.Intersect({ 0, i * TILE_ROWS, target->width, TILE_ROWS });
+			tile.SetDirtyRegion(region);
+
+			for (int32_t offset : bins[i])
+				Execute(&tile, commands.data() + offset);
+
+			if (i == 0)
+				result.CopyState(tile);
+		});
+
+		target->CopyState(result);
+	}
+
+	virtual void Reset() override
+	{
+		commands.clear();
+		strings.clear();
+		images.clear();
+		atlases.clear();
+		sprites.clear();
+		shapes.clear();
+		lines.clear();
+		points.clear();
+		count = 0;
+		hasLineColor = hasFillColor = hasBlendMode = hasAntialiasing = false;
+	}
+
+	virtual bool IsEmpty() override
+	{
+		return count == 0;
+	}
+
+	virtual int GetCommandCount() override
+	{
+		return count;
+	}
+
+	virtual void GetStats(GraphicsStats *const stats) override
+	{
+		*stats = this->stats;
+	}
+};
+
+DisplayList *simplegui::DisplayList::Create()
+{
+	return new CommandList();
+}
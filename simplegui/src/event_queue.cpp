@@ -0,0 +1,291 @@
+#include "event_queue.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace simplegui;
+
+//! \brief Get the kind of event which is held back when the queue is full.
+//!
+//! \param [in] type The event type.
+//!
+//! \return The index into the held events, or -1 if events of this type are
+//! not held back.
+static int HeldKind(int type)
+{
+	switch (type)
+	{
+	case EVENT_MOUSE_MOVED: return 0;
+	case EVENT_WINDOW_RESIZED: return 1;
+	case EVENT_WINDOW_MOVED: return 2;
+	case EVENT_WINDOW_CLOSING: return 3;
+	default: return -1;
+	}
+}
+
+EventQueue::EventQueue(int capacity) :
+	enabled(false), overflow(EVENT_QUEUE_DROP),
+	head(0), tail(0), hasHeld(false),
+	queued(0), dropped(0), coalesced(0),
+	sleeping(false), closed(false)
+{
+	uint32_t n = 1;
+	while (n < (uint32_t)capacity && n < 0x40000000)
+		n <<= 1;
+
+	ring.resize(n);
+	mask = n - 1;
+
+	for (int i = 0; i < HELD_KINDS; i++)
+		isHeld[i] = false;
+}
+
+void EventQueue::Publish(uint32_t h, const Event &evt)
+{
+	ring[h & mask] = evt;
+	head.store(h + 1, std::memory_order_release);
+}
+
+bool EventQueue::PublishHeld()
+{
+	bool published = false;
+	bool remaining = false;
+
+	{
+		std::lock_guard<std::mutex> lock(heldMutex);
+
+		for (int i = 0; i < HELD_KINDS; i++)
+		{
+			if (!isHeld[i])
+				continue;
+
+			uint32_t h = head.load(std::memory_order_relaxed);
+			if (Full(h))
+			{
+				remaining = true;
+				continue;
+			}
+
+			Publish(h, held[i]);
+			isHeld[i] = false;
+			published = true;
+		}
+
+		hasHeld.store(remaining, std::memory_order_release);
+	}
+
+	return published;
+}
+
+void EventQueue::Push(const Event &evt)
+{
+	/* held events are older, they go first */
+	if (hasHeld.load(std::memory_order_acquire) && PublishHeld())
+		Notify();
+
+	uint32_t h = head.load(std::memory_order_relaxed);
+	if (hasHeld.load(std::memory_order_relaxed) || Full(h))
+	{
+		int kind = HeldKind(evt.type);
+		if (kind >= 0)
+		{
+			std::lock_guard<std::mutex> lock(heldMutex);
+
+			if (isHeld[kind])
+				coalesced.fetch_add(1, std::memory_order_relaxed);
+			else
+				queued.fetch_add(1, std::memory_order_relaxed);
+
+			held[kind] = evt;
+			isHeld[kind] = true;
+			hasHeld.store(true, std::memory_order_release);
+			return;
+		}
+
+		if (overflow.load(std::memory_order_relaxed) != EVENT_QUEUE_BLOCK)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		/* wait for the consumer to make room */
+		for (;;)
+		{
+			if (hasHeld.load(std::memory_order_acquire) && PublishHeld())
+				Notify();
+
+			h = head.load(std::memory_order_relaxed);
+			if (!hasHeld.load(std::memory_order_relaxed) && !Full(h))
+				break;
+
+			if (closed.load(std::memory_order_acquire))
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			std::this_thread::yield();
+		}
+	}
+
+	Publish(h, evt);
+	queued.fetch_add(1, std::memory_order_relaxed);
+	Notify();
+}
+
+int EventQueue::Pop(Event *const events, int count)
+{
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t h = head.load(std::memory_order_acquire);
+	int n = 0;
+
+	while (n < count && t != h)
+		events[n++] = ring[t++ & mask];
+
+	tail.store(t, std::memory_order_release);
+
+	/* held events are newer than everything in the ring, take them once it
+	is empty */
+	if (n < count && hasHeld.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(heldMutex);
+
+		if (head.load(std::memory_order_acquire) == t)
+		{
+			bool remaining = false;
+			for (int i = 0; i < HELD_KINDS; i++)
+			{
+				if (!isHeld[i])
+					continue;
+
+				if (n < count)
+				{
+					events[n++] = held[i];
+					isHeld[i] = false;
+				}
+				else
+					remaining = true;
+			}
+
+			hasHeld.store(remaining, std::memory_order_release);
+		}
+	}
+
+	return n;
+}
+
+int EventQueue::Poll(Event *const events, int count, int timeout)
+{
+	int n = Pop(events, count);
+	if (n || timeout == 0 || count <= 0)
+		return n;
+
+	std::chrono::steady_clock::time_point deadline =
+		std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+	std::unique_lock<std::mutex> lock(sleepMutex);
+
+	for (;;)
+	{
+		/* announce the wait before looking at the queue again, so a
+		producer which adds an event after the check wakes us */
+		sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		n = Pop(events, count);
+		if (n || closed.load(std::memory_order_acquire))
+			break;
+
+		if (timeout < 0)
+			wake.wait(lock);
+		else if (wake.wait_until(lock, deadline) == std::cv_status::timeout)
+		{
+			n = Pop(events, count);
+			break;
+		}
+	}
+
+	sleeping.store(false, std::memory_order_relaxed);
+	return n;
+}
+
+void EventQueue::Notify()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!sleeping.load(std::memory_order_relaxed))
+		return;
+
+	std::lock_guard<std::mutex> lock(sleepMutex);
+	wake.notify_all();
+}
+
+void EventQueue::Close()
+{
+	closed.store(true, std::memory_order_release);
+
+	std::lock_guard<std::mutex> lock(sleepMutex);
+	wake.notify_all();
+}
+
+void EventQueue::GetStats(EventQueueStats *const stats) const
+{
+	stats->queued = queued.load(std::memory_order_relaxed);
+	stats->dropped = dropped.load(std::memory_order_relaxed);
+	stats->coalesced = coalesced.load(std::memory_order_relaxed);
+}
+
+void DispatchEvent(Window *win, const Event &evt, KeyListener *kl, MouseListener *ml, WindowListener *wl)
+{
+	MouseEvent mevt;
+
+	switch (evt.type)
+	{
+	case EVENT_KEY_DOWN:
+		if (kl) kl->KeyDown(win, evt.code);
+		break;
+	case EVENT_KEY_TYPED:
+		if (kl) kl->KeyTyped(win, (unsigned int)evt.code);
+		break;
+	case EVENT_KEY_UP:
+		if (kl) kl->KeyUp(win, evt.code);
+		break;
+
+	case EVENT_MOUSE_MOVED:
+		if (ml) ml->MouseMoved(win, evt.x, evt.y);
+		break;
+	case EVENT_MOUSE_DOWN:
+	case EVENT_MOUSE_UP:
+		mevt.x = evt.x;
+		mevt.y = evt.y;
+		mevt.button = evt.code;
+		mevt.count = 0;
+		mevt.mod = evt.mod;
+		if (ml && evt.type == EVENT_MOUSE_DOWN)
+			ml->MouseDown(win, mevt);
+		else if (ml)
+			ml->MouseUp(win, mevt);
+		break;
+	case EVENT_MOUSE_SCROLL:
+		if (ml) ml->MouseScroll(win, evt.code);
+		break;
+
+	case EVENT_WINDOW_CLOSING:
+		if (wl)
+			wl->WindowClosing(win);
+		else
+			win->Dispose();
+		break;
+	case EVENT_WINDOW_FOCUSED:
+		if (wl) wl->WindowFocused(win);
+		break;
+	case EVENT_WINDOW_UNFOCUSED:
+		if (wl) wl->WindowUnfocused(win);
+		break;
+	case EVENT_WINDOW_RESIZED:
+		if (wl) wl->WindowResized(win, evt.x, evt.y);
+		break;
+	case EVENT_WINDOW_MOVED:
+		if (wl) wl->WindowMoved(win, evt.x, evt.y);
+		break;
+	}
+}
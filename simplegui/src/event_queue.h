@@ -0,0 +1,106 @@
+#pragma once
+
+#include <simplegui.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+//! \brief Bounded queue of events with a single producer, the event thread,
+//! and a single consumer. Neither side takes a lock while the queue has
+//! room.
+//!
+//! When the queue is full, the latest mouse move and the latest window
+//! size, position and close event are held back, replacing older ones of
+//! the same kind, and are added as soon as there is room. Other events are
+//! dropped or make the producer wait, depending on the overflow policy.
+class EventQueue
+{
+public:
+	std::atomic<bool> enabled; // whether the producer records events
+	std::atomic<int> overflow; // one of EVENT_QUEUE_*
+
+	//! \brief Create an empty queue.
+	//!
+	//! \param [in] capacity The number of events, rounded up to a power of
+	//! two.
+	EventQueue(int capacity);
+
+	//! \brief Add an event. Producer only.
+	//!
+	//! \param [in] evt The event.
+	void Push(const simplegui::Event &evt);
+
+	//! \brief Take events without waiting. Consumer only.
+	//!
+	//! \param [out] events Receives the events, oldest first.
+	//! \param [in] count The maximum number of events to take.
+	//!
+	//! \return The number of events taken.
+	int Pop(simplegui::Event *const events, int count);
+
+	//! \brief Take events, waiting for some if the queue is empty. Consumer
+	//! only.
+	//!
+	//! \param [out] events Receives the events, oldest first.
+	//! \param [in] count The maximum number of events to take.
+	//! \param [in] timeout Milliseconds to wait, or -1 to wait until an
+	//! event arrives or the queue is closed.
+	//!
+	//! \return The number of events taken.
+	int Poll(simplegui::Event *const events, int count, int timeout);
+
+	//! \brief Stop waiting consumers and producers, called when the window
+	//! is disposed.
+	void Close();
+
+	//! \brief Get the counters.
+	//!
+	//! \param [out] stats Receives the counters.
+	void GetStats(simplegui::EventQueueStats *const stats) const;
+
+private:
+	static constexpr int HELD_KINDS = 4;
+
+	std::vector<simplegui::Event> ring;
+	uint32_t mask;
+
+	alignas(64) std::atomic<uint32_t> head; // next slot to write, only written by the producer
+	alignas(64) std::atomic<uint32_t> tail; // next slot to read, only written by the consumer
+
+	/* events held back while the queue is full, one per kind. Only touched
+	when the queue overflows, so the lock is off the fast path */
+	std::mutex heldMutex;
+	std::atomic<bool> hasHeld;
+	simplegui::Event held[HELD_KINDS];
+	bool isHeld[HELD_KINDS];
+
+	std::atomic<uint64_t> queued, dropped, coalesced;
+
+	/* consumers waiting for events */
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<bool> sleeping;
+	std::atomic<bool> closed;
+
+	bool Full(uint32_t h) const
+	{
+		return h - tail.load(std::memory_order_acquire) > mask;
+	}
+
+	void Publish(uint32_t h, const simplegui::Event &evt);
+	bool PublishHeld();
+	void Notify();
+};
+
+//! \brief Call the listener of an event.
+//!
+//! \param [in] win The window the event belongs to.
+//! \param [in] evt The event.
+//! \param [in] kl The key listener. Optional.
+//! \param [in] ml The mouse listener. Optional.
+//! \param [in] wl The window listener. Optional. Without one, closing events
+//! dispose of the window.
+void DispatchEvent(simplegui::Window *win, const simplegui::Event &evt,
+	simplegui::KeyListener *kl, simplegui::MouseListener *ml, simplegui::WindowListener *wl);
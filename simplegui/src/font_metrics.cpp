@@ -0,0 +1,65 @@
+#include "font_metrics.h"
+#include "raster.h"
+
+using namespace simplegui;
+
+simplegui::Font::Font() { }
+simplegui::Font::~Font() { }
+
+TableFont::TableFont()
+{
+	metrics = {};
+	for (int i = 0; i < 256; i++)
+		advances[i] = 0;
+}
+
+void TableFont::GetMetrics(FontMetrics *const metrics)
+{
+	*metrics = this->metrics;
+}
+
+int TableFont::GetAdvance(unsigned char ch)
+{
+	return advances[ch];
+}
+
+void TableFont::MeasureString(const char *string, int *const w, int *const h)
+{
+	int width = 0, lineWidth = 0, lines = 1;
+	for (const unsigned char *c = (const unsigned char *)string; *c; c++)
+	{
+		if (*c == '\n')
+		{
+			lineWidth = 0;
+			lines++;
+		}
+		else if ((lineWidth += advances[*c]) > width)
+			width = lineWidth;
+	}
+
+	if (w) *w = width;
+	if (h) *h = (lines - 1) * metrics.lineHeight + metrics.height;
+}
+
+Font *simplegui::Font::GetBuiltin()
+{
+	struct BuiltinFont : public TableFont
+	{
+		BuiltinFont()
+		{
+			/* every character takes a cell, even those without a glyph */
+			for (int i = 0; i < 256; i++)
+				advances[i] = FONT_ADVANCE;
+
+			metrics.ascent = FONT_GLYPH_HEIGHT - 1; // the last row is for descenders
+			metrics.descent = 1;
+			metrics.height = FONT_GLYPH_HEIGHT;
+			metrics.lineHeight = FONT_LINE_HEIGHT;
+			metrics.averageAdvance = FONT_ADVANCE;
+			metrics.maxAdvance = FONT_ADVANCE;
+		}
+	};
+
+	static BuiltinFont font;
+	return &font;
+}
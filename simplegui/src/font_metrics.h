@@ -0,0 +1,18 @@
+#pragma once
+
+#include <simplegui.h>
+
+//! \brief A font measured with a table of advance widths, filled in once
+//! when the font is created.
+class TableFont : public simplegui::Font
+{
+public:
+	simplegui::FontMetrics metrics;
+	int advances[256]; // horizontal distance to the next glyph, per character
+
+	TableFont();
+
+	virtual void GetMetrics(simplegui::FontMetrics *const metrics) override;
+	virtual int GetAdvance(unsigned char ch) override;
+	virtual void MeasureString(const char *string, int *const w, int *const h) override;
+};
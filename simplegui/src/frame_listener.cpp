@@ -0,0 +1,3 @@
+#include <simplegui.h>
+
+void simplegui::FrameListener::Update(Window *win, double dt) { }
@@ -0,0 +1,114 @@
+#include "frame_stream.h"
+
+using namespace simplegui;
+
+static constexpr uint32_t PENDING_MASK = 0x0f;
+static constexpr int FRONT_SHIFT = 4;
+
+FrameRing::FrameRing(int width, int height, int buffers) :
+	buffers(buffers < 2 ? 2 : buffers > MAX_BUFFERS ? MAX_BUFFERS : buffers),
+	state(0), back(-1), front(-1),
+	published(0), presented(0), dropped(0),
+	target(nullptr)
+{
+	for (int i = 0; i < MAX_BUFFERS; i++)
+		images[i] = i < this->buffers ? Image::Create(width, height) : nullptr;
+}
+
+FrameRing::~FrameRing()
+{
+	for (int i = 0; i < MAX_BUFFERS; i++)
+		delete images[i];
+}
+
+void FrameRing::SetTarget(FrameTarget *target)
+{
+	std::lock_guard<std::mutex> lock(targetMutex);
+	this->target = target;
+}
+
+void FrameRing::RemoveTarget(FrameTarget *target)
+{
+	std::lock_guard<std::mutex> lock(targetMutex);
+	if (this->target == target)
+		this->target = nullptr;
+}
+
+Image *FrameRing::BeginFrame()
+{
+	if (back >= 0)
+		return images[back];
+
+	/* the consumer only ever takes the pending buffer, so a buffer which is
+	free now stays free until it is published */
+	uint32_t s = state.load(std::memory_order_acquire);
+	int pending = (int)(s & PENDING_MASK) - 1;
+	int presenting = (int)(s >> FRONT_SHIFT) - 1;
+
+	for (int i = 0; i < buffers; i++)
+	{
+		if (i != pending && i != presenting)
+		{
+			back = i;
+			return images[i];
+		}
+	}
+
+	/* double buffered and the last frame has not been presented yet */
+	return nullptr;
+}
+
+void FrameRing::PublishFrame()
+{
+	if (back < 0)
+		return;
+
+	uint32_t s = state.load(std::memory_order_relaxed);
+	while (!state.compare_exchange_weak(s, (s & ~PENDING_MASK) | (uint32_t)(back + 1),
+		std::memory_order_acq_rel, std::memory_order_relaxed))
+		;
+
+	/* a frame which was never presented is replaced */
+	if (s & PENDING_MASK)
+		dropped.fetch_add(1, std::memory_order_relaxed);
+	published.fetch_add(1, std::memory_order_relaxed);
+	back = -1;
+
+	std::lock_guard<std::mutex> lock(targetMutex);
+	if (target)
+		target->FramePublished();
+}
+
+Image *FrameRing::AcquireFrame()
+{
+	uint32_t s = state.load(std::memory_order_acquire);
+	while (s & PENDING_MASK)
+	{
+		/* the pending frame becomes the presented one, the previously
+		presented buffer goes back to the producer */
+		uint32_t next = (s & PENDING_MASK) << FRONT_SHIFT;
+		if (state.compare_exchange_weak(s, next, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			front = (int)(s & PENDING_MASK) - 1;
+			presented.fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
+	}
+
+	return front >= 0 ? images[front] : nullptr;
+}
+
+void FrameRing::GetStats(FrameStreamStats *const stats)
+{
+	stats->published = published.load(std::memory_order_relaxed);
+	stats->presented = presented.load(std::memory_order_relaxed);
+	stats->dropped = dropped.load(std::memory_order_relaxed);
+}
+
+simplegui::FrameStream::FrameStream() { }
+simplegui::FrameStream::~FrameStream() { }
+
+FrameStream *simplegui::FrameStream::Create(int width, int height, int buffers)
+{
+	return new FrameRing(width, height, buffers);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <simplegui.h>
+
+#include <atomic>
+#include <mutex>
+
+//! \brief Told when a frame stream has a new frame, so it can be presented.
+class FrameTarget
+{
+public:
+	//! \brief Called on the producer thread after a frame is published. Must
+	//! not wait for painting.
+	virtual void FramePublished() = 0;
+};
+
+//! \brief Frame stream over two or three images. The producer writes into a
+//! buffer which is neither the latest published frame nor the one being
+//! presented, so neither side waits for the other. Publishing a frame
+//! before the previous one was presented drops the previous one.
+class FrameRing : public simplegui::FrameStream
+{
+public:
+	static constexpr int MAX_BUFFERS = 3;
+
+	simplegui::Image *images[MAX_BUFFERS];
+	int buffers;
+
+	/* low 4 bits are the published frame waiting to be presented, the next
+	4 bits the frame being presented, both as index + 1, 0 for none */
+	std::atomic<uint32_t> state;
+
+	int back; // buffer being written, only touched by the producer
+	int front; // buffer being presented, only touched by the consumer
+
+	std::atomic<uint64_t> published, presented, dropped;
+
+	std::mutex targetMutex; // held while notifying, so detaching waits for it
+	FrameTarget *target;
+
+	//! \brief Create a frame stream.
+	//!
+	//! \param [in] width The width of the frames.
+	//! \param [in] height The height of the frames.
+	//! \param [in] buffers The number of buffers, 2 or 3.
+	FrameRing(int width, int height, int buffers);
+	virtual ~FrameRing();
+
+	//! \brief Set the target told about new frames. Replaces the current
+	//! one. Once this returns, the previous target is not called anymore.
+	//!
+	//! \param [in] target The target, or null for none.
+	void SetTarget(FrameTarget *target);
+
+	//! \brief Remove a target if it is the current one.
+	//!
+	//! \param [in] target The target.
+	void RemoveTarget(FrameTarget *target);
+
+	virtual simplegui::Image *BeginFrame() override;
+	virtual void PublishFrame() override;
+	virtual simplegui::Image *AcquireFrame() override;
+	virtual void GetStats(simplegui::FrameStreamStats *const stats) override;
+};
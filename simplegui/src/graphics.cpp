@@ -0,0 +1,238 @@
+#include <simplegui.h>
+
+#include <climits>
+#include <cstddef>
+#include <vector>
+
+#include "pixel_image.h"
+#include "region.h"
+#include "sprite_atlas.h"
+
+//! \brief Clipping rectangles pushed through the default PushClipRect()
+struct simplegui::Graphics::ClipStack
+{
+	std::vector<Rect> rects; // intersection of the rectangles pushed up to each level
+};
+
+simplegui::Graphics::Graphics() :
+	clips(nullptr)
+{
+}
+
+simplegui::Graphics::~Graphics()
+{
+	delete clips;
+}
+
+int simplegui::Graphics::GetDirtyRects(Rect *const rects, int count)
+{
+	return 0;
+}
+
+bool simplegui::Graphics::IsDirty(int x, int y, int w, int h)
+{
+	return true;
+}
+
+void simplegui::Graphics::DrawImage(Image *image, int x, int y)
+{
+	if (!image) return;
+	DrawImage(image, x, y, image->GetWidth(), image->GetHeight(), FILTER_NEAREST);
+}
+
+void simplegui::Graphics::DrawImage(Image *image, int x, int y, int w, int h, int filter)
+{
+}
+
+void simplegui::Graphics::DrawSprites(SpriteAtlas *atlas, const SpriteInstance *instances, int count)
+{
+	if (!atlas || count <= 0) return;
+
+	SpriteTable table(atlas);
+	if (!table.image) return;
+
+	uint32_t *pixels = table.image->GetPixels();
+	int stride = table.image->GetStride();
+
+	/* one view into the surface, moved to each sprite without copying */
+	PixelImage view(pixels, 0, 0, stride);
+
+	for (int i = 0; i < count; i++)
+	{
+		const Rect *sprite = table.Find(instances[i].sprite);
+		if (!sprite)
+			continue;
+
+		view.pixels = pixels + (size_t)sprite->y * stride + sprite->x;
+		view.width = sprite->w;
+		view.height = sprite->h;
+		DrawImage(&view, instances[i].x, instances[i].y);
+	}
+}
+
+void simplegui::Graphics::FillRects(const ColorRect *rects, int count)
+{
+	if (count <= 0) return;
+
+	Color line, fill;
+	bool known = GetColors(&line, &fill);
+
+	for (int i = 0; i < count; i++)
+	{
+		SetColor(rects[i].color);
+		FillRect(rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+	}
+
+	if (known)
+	{
+		SetLineColor(line);
+		SetFillColor(fill);
+	}
+}
+
+void simplegui::Graphics::FillEllipses(const ColorRect *ellipses, int count)
+{
+	if (count <= 0) return;
+
+	Color line, fill;
+	bool known = GetColors(&line, &fill);
+
+	for (int i = 0; i < count; i++)
+	{
+		SetColor(ellipses[i].color);
+		FillEllipse(ellipses[i].x, ellipses[i].y, ellipses[i].w, ellipses[i].h);
+	}
+
+	if (known)
+	{
+		SetLineColor(line);
+		SetFillColor(fill);
+	}
+}
+
+void simplegui::Graphics::DrawLines(const ColorLine *lines, int count)
+{
+	if (count <= 0) return;
+
+	Color line;
+	bool known = GetColors(&line, nullptr);
+
+	for (int i = 0; i < count; i++)
+	{
+		SetLineColor(lines[i].color);
+		DrawLine(lines[i].x1, lines[i].y1, lines[i].x2, lines[i].y2);
+	}
+
+	if (known)
+		SetLineColor(line);
+}
+
+void simplegui::Graphics::DrawPolyline(const Point *points, int count)
+{
+	for (int i = 1; i < count; i++)
+		DrawLine(points[i - 1].x, points[i - 1].y, points[i].x, points[i].y);
+}
+
+void simplegui::Graphics::PushClipRect(int x, int y, int w, int h)
+{
+	if (!clips)
+		clips = new ClipStack();
+
+	Rect rc = { x, y, w > 0 ? w : 0, h > 0 ? h : 0 };
+	if (!clips->rects.empty())
+		rc = RectIntersection(clips->rects.back(), rc);
+
+	clips->rects.push_back(rc);
+	SetClipRect(rc.x, rc.y, rc.w, rc.h);
+}
+
+void simplegui::Graphics::PopClipRect()
+{
+	if (!clips || clips->rects.empty())
+		return;
+
+	clips->rects.pop_back();
+	if (clips->rects.empty())
+	{
+		/* nothing was known about the clipping before the first push */
+		SetClipRect(INT_MIN / 2, INT_MIN / 2, INT_MAX, INT_MAX);
+		return;
+	}
+
+	const Rect &rc = clips->rects.back();
+	SetClipRect(rc.x, rc.y, rc.w, rc.h);
+}
+
+bool simplegui::Graphics::GetColors(Color *const line, Color *const fill)
+{
+	return false;
+}
+
+void simplegui::Graphics::SetBlendMode(int mode)
+{
+}
+
+void simplegui::Graphics::SetAntialiasing(bool enabled)
+{
+}
+
+void simplegui::Graphics::GetStats(GraphicsStats *const stats)
+{
+	stats->stateChanges = 0;
+	stats->stateChangesElided = 0;
+}
+
+void simplegui::Graphics::DrawSeries(const Point *points, int count)
+{
+	if (count < 2) return;
+
+	/* consecutive points in a column are joined by vertical lines, covering
+	the rows between the lowest and highest of them, and so are the first,
+	lowest, highest and last of them in their order. The final point is not
+	drawn, but may be covered by the lines before it, so it is kept apart
+	from its column */
+	Point buffer[1024];
+	int n = 0;
+	int last = -1; // index of the last point in the buffer
+
+	for (int i = 0, end = count - 1; i <= end; )
+	{
+		int lo = i, hi = i, j = i + 1;
+		for (; j < end && points[j].x == points[i].x; j++)
+		{
+			if (points[j].y < points[lo].y) lo = j;
+			if (points[j].y > points[hi].y) hi = j;
+		}
+
+		/* the buffer starts over with the point the lines drawn so far
+		ended at */
+		if (n > 1024 - 4)
+		{
+			DrawPolyline(buffer, n);
+			buffer[0] = buffer[n - 1];
+			n = 1;
+		}
+
+		int keep[4] = { i, lo < hi ? lo : hi, lo < hi ? hi : lo, j - 1 };
+		for (int k = 0; k < 4; k++)
+		{
+			if (keep[k] != last)
+				buffer[n++] = points[keep[k]];
+			last = keep[k];
+		}
+
+		i = j;
+	}
+
+	DrawPolyline(buffer, n);
+}
+
+simplegui::Font *simplegui::Graphics::GetFont()
+{
+	return Font::GetBuiltin();
+}
+
+void simplegui::Graphics::MeasureString(const char *string, int *const w, int *const h)
+{
+	GetFont()->MeasureString(string, w, h);
+}
@@ -0,0 +1,757 @@
+#include <simplegui.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "event_queue.h"
+#include "frame_stream.h"
+#include "input_state.h"
+#include "memory_graphics.h"
+#include "region.h"
+
+using namespace simplegui;
+
+//! \brief Headless window backed by an in-memory framebuffer
+class MemoryWindow : public HeadlessWindow, public FrameTarget
+{
+public:
+	std::recursive_mutex mutex;
+	std::condition_variable_any cv;
+
+	std::vector<uint32_t> framebuffer;
+	int width, height;
+	int x, y;
+	std::string title;
+	Color bgcolor;
+
+	bool shown;
+	bool disposed;
+	DirtyRegion dirty; // invalidated since the last paint
+	uint64_t frames;
+
+	KeyListener *kl;
+	MouseListener *ml;
+	WindowListener *wl;
+	Painter *p;
+	FrameListener *fl;
+
+	double frameInterval; // seconds, 0 when running on demand
+	bool hasLastFrame;
+	std::chrono::steady_clock::time_point lastFrame;
+
+	MemoryWindow *parent;
+
+	/* written under the mutex, read without it */
+	InputSnapshot input;
+
+	int mouseMoveMode; // one of MOUSE_MOVE_*
+	std::vector<MouseSample> moves; // collected until they are delivered
+	std::mutex deliver; // held while moves are handed out, so batches and the button and scroll events after them keep their order
+
+	std::atomic<EventQueue *> queue; // created when events are first queued
+	std::mutex produce; // injecting threads take turns as the producer
+
+	FrameRing *stream; // presented before the painter runs
+	std::atomic<bool> streamDirty; // a frame was published since the last flush
+
+	MemoryWindow(int width, int height, const char *title, MemoryWindow *parent) :
+		width(0), height(0), x(0), y(0),
+		bgcolor(200, 200, 200),
+		shown(false), disposed(false), frames(0),
+		kl(0), ml(0), wl(0), p(0), fl(0),
+		frameInterval(0), hasLastFrame(false),
+		parent(parent),
+		mouseMoveMode(MOUSE_MOVE_IMMEDIATE),
+		queue(nullptr),
+		stream(nullptr), streamDirty(false)
+	{
+		/* set size and title */
+		SetSize(width, height);
+		SetTitle(title);
+	}
+
+	virtual ~MemoryWindow()
+	{
+		Dispose();
+		delete queue.load();
+	}
+
+	virtual void SetSize(int w, int h) override
+	{
+		WindowListener *wl;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+
+			if (disposed)
+				return;
+
+			if (w < 0) w = 0;
+			if (h < 0) h = 0;
+			if (w == width && h == height)
+				return;
+
+			width = w;
+			height = h;
+			framebuffer.assign((size_t)w * h, MemoryGraphics::ToPixel(bgcolor));
+			dirty.Add({ 0, 0, w, h });
+
+			wl = this->wl;
+		}
+
+		if (!QueueEvent(EVENT_WINDOW_RESIZED, w, h, 0, 0) && wl)
+			wl->WindowResized(this, w, h);
+	}
+
+	virtual void SetPos(int x, int y) override
+	{
+		WindowListener *wl;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+
+			if (disposed)
+				return;
+
+			this->x = x;
+			this->y = y;
+
+			wl = this->wl;
+		}
+
+		if (!QueueEvent(EVENT_WINDOW_MOVED, x, y, 0, 0) && wl)
+			wl->WindowMoved(this, x, y);
+	}
+
+	virtual void GetSize(int *const w, int *const h) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (w) *w = width;
+		if (h) *h = height;
+	}
+
+	virtual void GetPos(int *const x, int *const y) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (x) *x = this->x;
+		if (y) *y = this->y;
+	}
+
+	virtual void SetTitle(const char *title) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->title = title ? title : "";
+	}
+
+	virtual void Show(bool shown) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->shown = shown;
+	}
+
+	virtual void SetBackgroundColor(int r, int g, int b) override
+	{
+		SetBackgroundColor(Color(r, g, b));
+	}
+
+	virtual void SetBackgroundColor(Color color) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		bgcolor = color;
+	}
+
+	//! \brief Paint part of the window.
+	//! 
+	//! \param [in] region The region to repaint.
+	void PaintRegion(const DirtyRegion &region)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		if (disposed)
+			return;
+
+		frames++;
+
+		if (!p && !stream)
+			return;
+
+		MemoryGraphics g(framebuffer.data(), width, height, width);
+		g.background = MemoryGraphics::ToPixel(bgcolor);
+		g.SetDirtyRegion(region);
+
+		Image *frame = stream ? stream->AcquireFrame() : nullptr;
+		if (frame)
+			g.DrawImage(frame, 0, 0, width, height, FILTER_BILINEAR);
+
+		if (p)
+			p->Paint(this, &g);
+	}
+
+	virtual void Paint() override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		DirtyRegion all;
+		all.Add({ 0, 0, width, height });
+
+		dirty.Clear();
+		PaintRegion(all);
+	}
+
+	virtual void Repaint() override
+	{
+		Paint();
+	}
+
+	virtual void Invalidate() override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		dirty.Add({ 0, 0, width, height });
+	}
+
+	virtual void Invalidate(int x, int y, int w, int h) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		dirty.Add(RectIntersection({ x, y, w, h }, { 0, 0, width, height }));
+	}
+
+	virtual void SetDoubleBuffered(bool enabled) override
+	{
+		/* always painted into a persistent framebuffer */
+	}
+
+	virtual Font *GetFont() override
+	{
+		return Font::GetBuiltin();
+	}
+
+	virtual void Validate() override { }
+
+	virtual void Revalidate() override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		Invalidate();
+		Validate();
+	}
+
+	virtual void Wait() override
+	{
+		std::unique_lock<std::recursive_mutex> lock(mutex);
+		cv.wait(lock, [this] { return disposed; });
+	}
+
+	virtual void Dispose() override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		if (!disposed)
+		{
+			disposed = true;
+			cv.notify_all();
+
+			if (EventQueue *q = queue.load())
+				q->Close();
+
+			if (stream)
+				stream->RemoveTarget(this);
+		}
+	}
+
+	virtual bool IsDisposed() override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		return disposed;
+	}
+
+	virtual void SetKeyListener(KeyListener *kl) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->kl = kl;
+	}
+
+	virtual void SetMouseListener(MouseListener *ml) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->ml = ml;
+	}
+
+	virtual void SetWindowListener(WindowListener *wl) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->wl = wl;
+	}
+
+	virtual void SetPainter(Painter *p) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->p = p;
+	}
+
+	virtual void SetFrameStream(FrameStream *stream) override
+	{
+		/* only streams of the library can notify the window */
+		FrameRing *ring = dynamic_cast<FrameRing *>(stream);
+		FrameRing *old;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			old = this->stream;
+			this->stream = ring;
+		}
+
+		if (old)
+			old->RemoveTarget(this);
+		if (ring)
+			ring->SetTarget(this);
+
+		Invalidate();
+	}
+
+	virtual void FramePublished() override
+	{
+		/* picked up by the next flush, the producer does not wait for a
+		paint in progress */
+		streamDirty.store(true, std::memory_order_release);
+	}
+
+	virtual void SetFrameListener(FrameListener *fl) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		this->fl = fl;
+	}
+
+	virtual void SetFrameRate(double fps) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		frameInterval = fps > 0 ? 1.0 / fps : 0;
+	}
+
+	//! \brief Get the time step for the next frame.
+	//! 
+	//! \return The fixed frame interval if a frame rate is set, otherwise the
+	//! time elapsed since the previous frame.
+	double NextFrameDelta()
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double dt = 0;
+
+		if (frameInterval > 0)
+			dt = frameInterval;
+		else if (hasLastFrame)
+			dt = std::chrono::duration<double>(now - lastFrame).count();
+
+		lastFrame = now;
+		hasLastFrame = true;
+		return dt;
+	}
+
+	//! \brief Test whether events go to the event queue.
+	//! 
+	//! \return true if events are queued, false if the listeners are called
+	//! directly.
+	bool QueueingEvents()
+	{
+		EventQueue *q = queue.load(std::memory_order_acquire);
+		return q && q->enabled.load(std::memory_order_relaxed);
+	}
+
+	//! \brief Record an event if events are queued.
+	//! 
+	//! \param [in] type One of EVENT_*.
+	//! \param [in] x The x position or width.
+	//! \param [in] y The y position or height.
+	//! \param [in] code The key, scan code, mouse button or scroll amount.
+	//! \param [in] mod The modifier keys.
+	//! 
+	//! \return true if the event was queued, false if the listeners are to
+	//! be called directly.
+	bool QueueEvent(int type, int x, int y, int code, int mod)
+	{
+		if (!QueueingEvents())
+			return false;
+
+		std::lock_guard<std::mutex> lock(produce);
+		queue.load(std::memory_order_relaxed)->Push({ type, x, y, code, mod });
+		return true;
+	}
+
+	//! \brief Hand collected mouse moves to the mouse listener. Returns
+	//! once moves another thread is delivering have been handed out too.
+	void DeliverMouseMoves()
+	{
+		std::lock_guard<std::mutex> order(deliver);
+		std::vector<MouseSample> delivering;
+		MouseListener *ml;
+		int mode;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+
+			if (moves.empty())
+				return;
+
+			/* deliver outside of the window lock */
+			delivering.swap(moves);
+
+			ml = this->ml;
+			mode = mouseMoveMode;
+		}
+
+		if (QueueingEvents())
+		{
+			/* a batch becomes one event per position */
+			size_t first = mode == MOUSE_MOVE_BATCHED ? 0 : delivering.size() - 1;
+			for (size_t i = first; i < delivering.size(); i++)
+				QueueEvent(EVENT_MOUSE_MOVED, delivering[i].x, delivering[i].y, 0, 0);
+		}
+		else if (ml && mode == MOUSE_MOVE_BATCHED)
+			ml->MouseMovedBatch(this, delivering.data(), (int)delivering.size());
+		else if (ml)
+			ml->MouseMoved(this, delivering.back().x, delivering.back().y);
+	}
+
+	virtual void SetMouseMoveMode(int mode) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		mouseMoveMode = mode;
+	}
+
+	virtual void SetEventQueue(int capacity, int overflow) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		EventQueue *q = queue.load(std::memory_order_relaxed);
+		if (!q && capacity <= 0)
+			return;
+
+		if (!q)
+			q = new EventQueue(capacity);
+
+		q->overflow.store(overflow, std::memory_order_relaxed);
+		q->enabled.store(capacity > 0, std::memory_order_relaxed);
+		queue.store(q, std::memory_order_release);
+	}
+
+	virtual int PollEvents(Event *const events, int count, int timeout) override
+	{
+		EventQueue *q = queue.load(std::memory_order_acquire);
+		return q ? q->Poll(events, count, timeout) : 0;
+	}
+
+	virtual int DispatchEvents(int timeout) override
+	{
+		static constexpr int batch = 64;
+		Event events[batch];
+		int total = 0;
+
+		for (int n = PollEvents(events, batch, timeout); n > 0; n = PollEvents(events, batch, 0))
+		{
+			KeyListener *kl;
+			MouseListener *ml;
+			WindowListener *wl;
+
+			{
+				std::lock_guard<std::recursive_mutex> lock(mutex);
+				kl = this->kl;
+				ml = this->ml;
+				wl = this->wl;
+			}
+
+			for (int i = 0; i < n; i++)
+				DispatchEvent(this, events[i], kl, ml, wl);
+
+			total += n;
+			if (n < batch)
+				break;
+		}
+
+		return total;
+	}
+
+	virtual void GetEventQueueStats(EventQueueStats *const stats) override
+	{
+		EventQueue *q = queue.load(std::memory_order_acquire);
+		if (q)
+			q->GetStats(stats);
+		else
+			*stats = { 0, 0, 0 };
+	}
+
+	virtual bool GetAsyncKey(int vk) override
+	{
+		return input.GetKey(vk);
+	}
+
+	virtual void GetAsyncKeys(const int *vks, bool *const states, int count) override
+	{
+		for (int i = 0; i < count; i++)
+			states[i] = input.GetKey(vks[i]);
+	}
+
+	virtual bool GetAsyncMouseButton(int mb) override
+	{
+		return input.GetMouseButton(mb);
+	}
+
+	virtual void GetAsyncMouseButtons(const int *mbs, bool *const states, int count) override
+	{
+		for (int i = 0; i < count; i++)
+			states[i] = input.GetMouseButton(mbs[i]);
+	}
+
+	virtual void GetAsyncMousePosition(int *const x, int *const y) override
+	{
+		input.GetMousePosition(x, y);
+	}
+
+	virtual void GetInputState(InputState *const state) override
+	{
+		input.Read(state);
+	}
+
+	virtual Window *CreateChild(int width, int height, const char *title) override
+	{
+		return new MemoryWindow(width, height, title, this);
+	}
+
+	virtual bool Flush() override
+	{
+		FrameListener *fl;
+		double dt = 0;
+
+		DeliverMouseMoves();
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+
+			if (disposed)
+				return false;
+
+			fl = this->fl;
+			if (fl)
+				dt = NextFrameDelta();
+		}
+
+		if (fl)
+			fl->Update(this, dt);
+
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		if (streamDirty.exchange(false, std::memory_order_acquire))
+			dirty.Add({ 0, 0, width, height });
+
+		if (dirty.IsEmpty())
+			return false;
+
+		DirtyRegion region = dirty;
+		dirty.Clear();
+		PaintRegion(region);
+		return true;
+	}
+
+	virtual const uint32_t *GetPixels(int *const w, int *const h, int *const stride) override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (w) *w = width;
+		if (h) *h = height;
+		if (stride) *stride = width;
+		return framebuffer.data();
+	}
+
+	virtual uint64_t GetFrameCount() override
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		return frames;
+	}
+
+	virtual void InjectKeyDown(int vk) override
+	{
+		KeyListener *kl;
+		bool old;
+
+		if (vk < 0 || vk >= InputSnapshot::nKeys)
+			return;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			old = input.SetKey(vk, true);
+			kl = this->kl;
+		}
+
+		if (!old && !QueueEvent(EVENT_KEY_DOWN, 0, 0, vk, 0) && kl)
+			kl->KeyDown(this, vk);
+	}
+
+	virtual void InjectKeyTyped(unsigned int scancode) override
+	{
+		KeyListener *kl;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			kl = this->kl;
+		}
+
+		if (!QueueEvent(EVENT_KEY_TYPED, 0, 0, (int)scancode, 0) && kl)
+			kl->KeyTyped(this, scancode);
+	}
+
+	virtual void InjectKeyUp(int vk) override
+	{
+		KeyListener *kl;
+		bool old;
+
+		if (vk < 0 || vk >= InputSnapshot::nKeys)
+			return;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			old = input.SetKey(vk, false);
+			kl = this->kl;
+		}
+
+		if (old && !QueueEvent(EVENT_KEY_UP, 0, 0, vk, 0) && kl)
+			kl->KeyUp(this, vk);
+	}
+
+	virtual void InjectMouseMove(int x, int y) override
+	{
+		MouseListener *ml;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			input.SetMousePosition(x, y);
+
+			if (mouseMoveMode != MOUSE_MOVE_IMMEDIATE)
+			{
+				double time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+				moves.push_back({ x, y, time });
+				return;
+			}
+
+			ml = this->ml;
+		}
+
+		if (!QueueEvent(EVENT_MOUSE_MOVED, x, y, 0, 0) && ml)
+			ml->MouseMoved(this, x, y);
+	}
+
+	virtual void InjectMouseDown(int mb, int x, int y) override
+	{
+		MouseListener *ml;
+		MouseEvent evt;
+
+		if (mb < 1 || mb > InputSnapshot::nMbuttons)
+			return;
+
+		DeliverMouseMoves();
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			input.SetMouseButton(mb, true);
+			input.SetMousePosition(x, y);
+
+			evt.button = mb;
+			evt.count = 0;
+			evt.mod = input.ModifierKeys();
+			evt.x = x;
+			evt.y = y;
+
+			ml = this->ml;
+		}
+
+		if (!QueueEvent(EVENT_MOUSE_DOWN, x, y, mb, evt.mod) && ml)
+			ml->MouseDown(this, evt);
+	}
+
+	virtual void InjectMouseUp(int mb, int x, int y) override
+	{
+		MouseListener *ml;
+		MouseEvent evt;
+
+		if (mb < 1 || mb > InputSnapshot::nMbuttons)
+			return;
+
+		DeliverMouseMoves();
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			input.SetMouseButton(mb, false);
+			input.SetMousePosition(x, y);
+
+			evt.button = mb;
+			evt.count = 0;
+			evt.mod = input.ModifierKeys();
+			evt.x = x;
+			evt.y = y;
+
+			ml = this->ml;
+		}
+
+		if (!QueueEvent(EVENT_MOUSE_UP, x, y, mb, evt.mod) && ml)
+			ml->MouseUp(this, evt);
+	}
+
+	virtual void InjectMouseScroll(int amount) override
+	{
+		MouseListener *ml;
+
+		DeliverMouseMoves();
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			ml = this->ml;
+		}
+
+		if (!QueueEvent(EVENT_MOUSE_SCROLL, 0, 0, amount, 0) && ml)
+			ml->MouseScroll(this, amount);
+	}
+
+	virtual void InjectClose() override
+	{
+		WindowListener *wl;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			wl = this->wl;
+		}
+
+		if (QueueEvent(EVENT_WINDOW_CLOSING, 0, 0, 0, 0))
+			return;
+
+		if (wl)
+			wl->WindowClosing(this);
+		else
+			Dispose();
+	}
+
+	virtual void InjectFocus(bool focused) override
+	{
+		WindowListener *wl;
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			wl = this->wl;
+		}
+
+		if (QueueEvent(focused ? EVENT_WINDOW_FOCUSED : EVENT_WINDOW_UNFOCUSED, 0, 0, 0, 0))
+			return;
+
+		if (!wl)
+			return;
+
+		if (focused)
+			wl->WindowFocused(this);
+		else
+			wl->WindowUnfocused(this);
+	}
+};
+
+HeadlessWindow *simplegui::HeadlessWindow::Create(int width, int height, const char *title)
+{
+	return new MemoryWindow(width, height, title, nullptr);
+}
@@ -0,0 +1,20 @@
+#include <simplegui.h>
+
+#include "pixel_image.h"
+
+using namespace simplegui;
+
+simplegui::Image::Image() { }
+simplegui::Image::~Image() { }
+
+Image *simplegui::Image::Create(int width, int height)
+{
+	if (width < 0) width = 0;
+	if (height < 0) height = 0;
+	return new PixelImage(width, height);
+}
+
+Image *simplegui::Image::Wrap(uint32_t *pixels, int width, int height, int stride)
+{
+	return new PixelImage(pixels, width, height, stride);
+}
@@ -0,0 +1,123 @@
+#include "input_state.h"
+
+using namespace simplegui;
+
+InputSnapshot::InputSnapshot() :
+	sequence(0), mbuttons(0), mouseX(0), mouseY(0)
+{
+	/* keys and mouse buttons not pressed initially */
+	for (int i = 0; i < nKeyWords; i++)
+		keys[i].store(0, std::memory_order_relaxed);
+}
+
+void InputSnapshot::BeginWrite()
+{
+	uint32_t seq = sequence.load(std::memory_order_relaxed);
+	sequence.store(seq + 1, std::memory_order_relaxed);
+
+	/* the odd sequence becomes visible before any of the state */
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void InputSnapshot::EndWrite()
+{
+	uint32_t seq = sequence.load(std::memory_order_relaxed);
+	sequence.store(seq + 1, std::memory_order_release);
+}
+
+bool InputSnapshot::SetKey(int vk, bool down)
+{
+	if (vk < 0 || vk >= nKeys)
+		return false;
+
+	std::atomic<uint32_t> &word = keys[vk >> 5];
+	uint32_t bit = 1u << (vk & 31);
+	uint32_t old = word.load(std::memory_order_relaxed);
+
+	/* nothing changes on key repeat, readers need not retry */
+	if (((old & bit) != 0) == down)
+		return down;
+
+	BeginWrite();
+	word.store(down ? old | bit : old & ~bit, std::memory_order_release);
+	EndWrite();
+
+	return !down;
+}
+
+bool InputSnapshot::SetMouseButton(int mb, bool down)
+{
+	if (mb < 1 || mb > nMbuttons)
+		return false;
+
+	uint32_t bit = 1u << (mb - 1);
+	uint32_t old = mbuttons.load(std::memory_order_relaxed);
+
+	if (((old & bit) != 0) == down)
+		return down;
+
+	BeginWrite();
+	mbuttons.store(down ? old | bit : old & ~bit, std::memory_order_release);
+	EndWrite();
+
+	return !down;
+}
+
+void InputSnapshot::SetMousePosition(int x, int y)
+{
+	BeginWrite();
+	mouseX.store(x, std::memory_order_relaxed);
+	mouseY.store(y, std::memory_order_relaxed);
+	EndWrite();
+}
+
+int InputSnapshot::ModifierKeys() const
+{
+	InputState state;
+	Read(&state);
+	return state.mod;
+}
+
+void InputSnapshot::GetMousePosition(int *const x, int *const y) const
+{
+	InputState state;
+	Read(&state);
+
+	if (x) *x = state.x;
+	if (y) *y = state.y;
+}
+
+void InputSnapshot::Read(InputState *const state) const
+{
+	uint32_t before, after;
+
+	do
+	{
+		/* wait out an update in progress */
+		while ((before = sequence.load(std::memory_order_acquire)) & 1)
+			;
+
+		for (int i = 0; i < nKeyWords; i++)
+			state->keys[i] = keys[i].load(std::memory_order_relaxed);
+		state->mbuttons = mbuttons.load(std::memory_order_relaxed);
+		state->x = mouseX.load(std::memory_order_relaxed);
+		state->y = mouseY.load(std::memory_order_relaxed);
+
+		/* the state is read before the sequence is read again */
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = sequence.load(std::memory_order_relaxed);
+	} while (before != after);
+
+	int mods = 0;
+
+	if (state->IsKeyDown(KEY_LSHIFT)) mods |= MOD_LSHIFT;
+	if (state->IsKeyDown(KEY_RSHIFT)) mods |= MOD_RSHIFT;
+
+	if (state->IsKeyDown(KEY_LMENU)) mods |= MOD_LALT;
+	if (state->IsKeyDown(KEY_RMENU)) mods |= MOD_RALT;
+
+	if (state->IsKeyDown(KEY_LWIN)) mods |= MOD_LWIN;
+	if (state->IsKeyDown(KEY_RWIN)) mods |= MOD_RWIN;
+
+	state->mod = mods;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <simplegui.h>
+
+#include <atomic>
+
+//! \brief Keyboard and mouse state of a window, written by one thread at a
+//! time and read by any thread without taking a lock.
+//!
+//! Single keys and mouse buttons are read straight from atomic bitsets.
+//! Snapshots of the whole state are made consistent with a sequence lock:
+//! the writer makes the sequence odd while it updates the state, and readers
+//! retry until they saw the same even sequence before and after reading.
+class InputSnapshot
+{
+public:
+	static constexpr int nKeys = 256;
+	static constexpr int nMbuttons = 16;
+	static constexpr int nKeyWords = nKeys / 32;
+
+	std::atomic<uint32_t> sequence; // odd while an update is in progress
+	std::atomic<uint32_t> keys[nKeyWords]; // bit vk % 32 of word vk / 32
+	std::atomic<uint32_t> mbuttons; // bit mb - 1
+	std::atomic<int> mouseX, mouseY;
+
+	InputSnapshot();
+
+	//! \brief Set the state of a key. Writer only.
+	//!
+	//! \param [in] vk The virtual key code.
+	//! \param [in] down Whether the key is pressed.
+	//!
+	//! \return The previous state of the key, false if the key does not exist.
+	bool SetKey(int vk, bool down);
+
+	//! \brief Set the state of a mouse button. Writer only.
+	//!
+	//! \param [in] mb The mouse button (1, 2, 3, ...).
+	//! \param [in] down Whether the button is pressed.
+	//!
+	//! \return The previous state of the button, false if the button does
+	//! not exist.
+	bool SetMouseButton(int mb, bool down);
+
+	//! \brief Set the position of the mouse. Writer only.
+	//!
+	//! \param [in] x The x position.
+	//! \param [in] y The y position.
+	void SetMousePosition(int x, int y);
+
+	//! \brief Get the state of a key.
+	//!
+	//! \param [in] vk The virtual key code.
+	//!
+	//! \return true if the key is pressed, false if it is not or does not
+	//! exist.
+	bool GetKey(int vk) const
+	{
+		if (vk < 0 || vk >= nKeys)
+			return false;
+		return (keys[vk >> 5].load(std::memory_order_acquire) >> (vk & 31)) & 1;
+	}
+
+	//! \brief Get the state of a mouse button.
+	//!
+	//! \param [in] mb The mouse button (1, 2, 3, ...).
+	//!
+	//! \return true if the button is pressed, false if it is not or does not
+	//! exist.
+	bool GetMouseButton(int mb) const
+	{
+		if (mb < 1 || mb > nMbuttons)
+			return false;
+		return (mbuttons.load(std::memory_order_acquire) >> (mb - 1)) & 1;
+	}
+
+	//! \brief Get the modifier keys held.
+	//!
+	//! \return A combination of MOD_*.
+	int ModifierKeys() const;
+
+	//! \brief Get the position of the mouse. Both coordinates come from the
+	//! same update.
+	//!
+	//! \param [out] x The x position. Optional.
+	//! \param [out] y The y position. Optional.
+	void GetMousePosition(int *const x, int *const y) const;
+
+	//! \brief Take a consistent snapshot of the whole state.
+	//!
+	//! \param [out] state Receives the state.
+	void Read(simplegui::InputState *const state) const;
+
+private:
+	void BeginWrite();
+	void EndWrite();
+};
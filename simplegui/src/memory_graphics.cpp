@@ -0,0 +1,1030 @@
+#include "memory_graphics.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "raster.h"
+#include "sprite_atlas.h"
+
+using namespace simplegui;
+
+//! \brief Test whether the center of a pixel is inside an ellipse.
+//!
+//! \param [in] j The column, relative to the bounding box.
+//! \param [in] i The row, relative to the bounding box.
+//! \param [in] w The width of the bounding box.
+//! \param [in] h The height of the bounding box.
+//!
+//! \return true if the pixel is inside.
+static inline bool InsideEllipse(int j, int i, int w, int h)
+{
+	/* in doubled coordinates relative to the center, u^2 / w^2 + v^2 / h^2 <= 1 */
+	int64_t u = 2 * (int64_t)j + 1 - w;
+	int64_t v = 2 * (int64_t)i + 1 - h;
+
+	/* the products overflow 64 bits beyond this */
+	if (w > 40000 || h > 40000)
+		return (double)(u * u) * h * h + (double)(v * v) * w * w <= (double)w * w * h * h;
+
+	return (uint64_t)(u * u * h * h) + (uint64_t)(v * v * w * w) <= (uint64_t)w * w * h * h;
+}
+
+//! \brief Compute the horizontal extent of rows of an ellipse with the
+//! midpoint algorithm. A row covers the pixels whose centers are inside the
+//! ellipse, and at least the middle one or two pixels. Rows are symmetric,
+//! so only the distance from the left edge is stored.
+//!
+//! \param [in] w The width of the bounding box.
+//! \param [in] h The height of the bounding box.
+//! \param [in] first The first row to compute.
+//! \param [in] last One past the last row to compute.
+//! \param [out] inset The first column of each row, relative to the left
+//! edge, h elements. Each row covers w - 2 * inset pixels.
+static void EllipseInsets(int w, int h, int first, int last, int *inset)
+{
+	int middle = (w - 1) / 2;
+	int j = middle;
+
+	/* the edge moves outwards down to the middle row and inwards below it,
+	one column at a time, so every row starts where the previous one ended */
+	for (int i = first; i < last; i++)
+	{
+		while (j > 0 && InsideEllipse(j - 1, i, w, h))
+			j--;
+		while (j < middle && !InsideEllipse(j, i, w, h))
+			j++;
+
+		inset[i] = j;
+	}
+}
+
+MemoryGraphics::MemoryGraphics(uint32_t *pixels, int width, int height, int stride) :
+	pixels(pixels), width(width), height(height), stride(stride),
+	blendMode(BLEND_NONE), lineSource(0xff000000), fillSource(0xff000000),
+	lineColor(0xff000000), fillColor(0xff000000), background(0xffffffff),
+	antialias(false), stats(), clip({ 0, 0, width, height })
+{
+	for (EllipseRows &entry : ellipseCache)
+		entry.w = entry.h = 0;
+
+	dirty.Add(clip);
+	UpdateClip();
+}
+
+MemoryGraphics::~MemoryGraphics()
+{
+	Dispose();
+}
+
+void MemoryGraphics::SetDirtyRegion(const DirtyRegion &region)
+{
+	dirty = region;
+	dirty.Intersect({ 0, 0, width, height });
+	UpdateClip();
+}
+
+void MemoryGraphics::CopyState(const MemoryGraphics &other)
+{
+	blendMode = other.blendMode;
+	antialias = other.antialias;
+	lineSource = other.lineSource;
+	fillSource = other.fillSource;
+	lineColor = other.lineColor;
+	fillColor = other.fillColor;
+	background = other.background;
+	stats = other.stats;
+
+	clip = other.clip;
+	clipStack = other.clipStack;
+	UpdateClip();
+}
+
+void MemoryGraphics::UpdateClip()
+{
+	visible = dirty;
+	visible.Intersect(clip);
+
+	Rect bounds = visible.Bounds();
+	clipLeft = bounds.x;
+	clipTop = bounds.y;
+	clipRight = bounds.x + bounds.w;
+	clipBottom = bounds.y + bounds.h;
+}
+
+void MemoryGraphics::UpdateColors()
+{
+	lineColor = Resolve(lineSource);
+	fillColor = Resolve(fillSource);
+}
+
+//! \brief Fill or blend a run of pixels, depending on the alpha of the color.
+static inline void Fill(uint32_t *dst, uint32_t color, size_t count)
+{
+	if ((color >> 24) == 0xff)
+		FillSpan(dst, color, count);
+	else
+		BlendSpan(dst, color, count);
+}
+
+void MemoryGraphics::Span(int y, int x0, int x1, uint32_t color)
+{
+	if (y < clipTop || y >= clipBottom)
+		return;
+
+	/* fully transparent */
+	if (!(color >> 24))
+		return;
+
+	if (visible.count == 1)
+	{
+		if (x0 < clipLeft) x0 = clipLeft;
+		if (x1 > clipRight) x1 = clipRight;
+		if (x0 < x1)
+			Fill(pixels + (size_t)y * stride + x0, color, x1 - x0);
+		return;
+	}
+
+	for (int i = 0; i < visible.count; i++)
+	{
+		const Rect &rc = visible.rects[i];
+		if (y < rc.y || y >= rc.y + rc.h)
+			continue;
+
+		int l = x0 < rc.x ? rc.x : x0;
+		int r = x1 > rc.x + rc.w ? rc.x + rc.w : x1;
+		if (l < r)
+			Fill(pixels + (size_t)y * stride + l, color, r - l);
+	}
+}
+
+void MemoryGraphics::Block(int x0, int y0, int x1, int y1, uint32_t color)
+{
+	if (!(color >> 24))
+		return;
+
+	bool opaque = (color >> 24) == 0xff;
+	for (int i = 0; i < visible.count; i++)
+	{
+		const Rect &rc = visible.rects[i];
+
+		int l = x0 < rc.x ? rc.x : x0;
+		int t = y0 < rc.y ? rc.y : y0;
+		int r = x1 > rc.x + rc.w ? rc.x + rc.w : x1;
+		int b = y1 > rc.y + rc.h ? rc.y + rc.h : y1;
+		if (l >= r || t >= b)
+			continue;
+
+		if (opaque)
+			FillBlock(pixels + (size_t)t * stride + l, stride, color, r - l, b - t);
+		else
+			BlendBlock(pixels + (size_t)t * stride + l, stride, color, r - l, b - t);
+	}
+}
+
+void MemoryGraphics::Plot(int x, int y, uint32_t color)
+{
+	if (x < clipLeft || x >= clipRight || y < clipTop || y >= clipBottom)
+		return;
+
+	if (visible.count > 1 && !visible.Intersects({ x, y, 1, 1 }))
+		return;
+
+	if ((color >> 24) == 0xff)
+		pixels[(size_t)y * stride + x] = color;
+	else if (color >> 24)
+		BlendSpan(pixels + (size_t)y * stride + x, color, 1);
+}
+
+void MemoryGraphics::DrawRect(int x, int y, int w, int h)
+{
+	if (!pixels) return;
+	if (w < 0 || h < 0) return;
+	if (!Visible(x, y, x + w + 1, y + h + 1)) return;
+
+	/* same pixels as the closed polyline of the GDI backend */
+	Span(y, x, x + w + 1, lineColor);
+	if (h > 0)
+		Span(y + h, x, x + w + 1, lineColor);
+
+	for (int row = y + 1; row < y + h; row++)
+	{
+		Plot(x, row, lineColor);
+		if (w > 0)
+			Plot(x + w, row, lineColor);
+	}
+}
+
+void MemoryGraphics::FillRect(int x, int y, int w, int h)
+{
+	if (!pixels) return;
+	if (w <= 0 || h <= 0) return;
+	if (!Visible(x, y, x + w, y + h)) return;
+
+	/* outline */
+	Span(y, x, x + w, lineColor);
+	if (h > 1)
+		Span(y + h - 1, x, x + w, lineColor);
+
+	Block(x, y + 1, x + 1, y + h - 1, lineColor);
+	if (w > 1)
+		Block(x + w - 1, y + 1, x + w, y + h - 1, lineColor);
+
+	/* interior */
+	Block(x + 1, y + 1, x + w - 1, y + h - 1, fillColor);
+}
+
+const int *MemoryGraphics::EllipseShape(int w, int h, int first, int last)
+{
+	/* small ellipses are drawn over and over as markers, keep their rows */
+	if (w <= ELLIPSE_CACHE_MAX && h <= ELLIPSE_CACHE_MAX)
+	{
+		EllipseRows &entry = ellipseCache[(w * 31 + h) & (ELLIPSE_CACHE_SIZE - 1)];
+		if (entry.w != w || entry.h != h)
+		{
+			entry.w = w;
+			entry.h = h;
+			entry.inset.resize(h);
+			EllipseInsets(w, h, 0, h, entry.inset.data());
+		}
+		return entry.inset.data();
+	}
+
+	if (ellipse.size() < (size_t)h)
+		ellipse.resize(h);
+
+	EllipseInsets(w, h, first, last, ellipse.data());
+	return ellipse.data();
+}
+
+void MemoryGraphics::Ellipse(int x, int y, int w, int h, uint32_t line, uint32_t fill, bool filled)
+{
+	if (w <= 0 || h <= 0) return;
+	if (!Visible(x, y, x + w, y + h)) return;
+
+	/* only the visible rows, and their neighbours to tell the outline apart */
+	int first = clipTop - y > 0 ? clipTop - y : 0;
+	int last = clipBottom - y < h ? clipBottom - y : h;
+	const int *inset = EllipseShape(w, h, first > 0 ? first - 1 : 0, last < h ? last + 1 : h);
+
+	/* the outline and the interior are the same, no need to tell them apart */
+	if (filled && line == fill)
+	{
+		/* markers are small and usually completely visible, their rows are
+		written without clipping each one */
+		if (!(fill >> 24))
+			return;
+
+		if (visible.count == 1 && x >= clipLeft && x + w <= clipRight && y >= clipTop && y + h <= clipBottom)
+		{
+			uint32_t *origin = pixels + (size_t)y * stride + x;
+			for (int i = 0; i < h; i++, origin += stride)
+				Fill(origin + inset[i], fill, w - 2 * inset[i]);
+			return;
+		}
+
+		for (int i = first; i < last; i++)
+			Span(y + i, x + inset[i], x + w - inset[i], fill);
+		return;
+	}
+
+	for (int i = first; i < last; i++)
+	{
+		int row = y + i;
+		int l = x + inset[i];
+		int r = x + w - inset[i];
+
+		/* a pixel is interior if it is covered by the rows above and below */
+		int in = w;
+		if (i > 0 && i < h - 1)
+		{
+			in = inset[i] + 1;
+			if (inset[i - 1] > in) in = inset[i - 1];
+			if (inset[i + 1] > in) in = inset[i + 1];
+		}
+
+		int il = x + in;
+		int ir = x + w - in;
+		if (il >= ir)
+		{
+			Span(row, l, r, line);
+			continue;
+		}
+
+		Span(row, l, il, line);
+		if (filled)
+			Span(row, il, ir, fill);
+		Span(row, ir, r, line);
+	}
+}
+
+void MemoryGraphics::DrawEllipse(int x, int y, int w, int h)
+{
+	if (!pixels) return;
+	Ellipse(x, y, w, h, lineColor, fillColor, false);
+}
+
+void MemoryGraphics::FillEllipse(int x, int y, int w, int h)
+{
+	if (!pixels) return;
+	Ellipse(x, y, w, h, lineColor, fillColor, true);
+}
+
+void MemoryGraphics::Line(int x1, int y1, int x2, int y2, uint32_t color)
+{
+	if (!(color >> 24)) return;
+	if (!Visible(x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2, (x1 > x2 ? x1 : x2) + 1, (y1 > y2 ? y1 : y2) + 1)) return;
+
+	if (antialias)
+	{
+		SmoothLine(x1, y1, x2, y2, color);
+		return;
+	}
+
+	/* Bresenham along the major axis, the end point is not drawn. Pixel i is
+	i steps along the major axis and round(i * minor / major) steps along
+	the minor one, so the pixels within the clipping bounds are found without
+	walking the rest of the line */
+	bool steep = abs(y2 - y1) > abs(x2 - x1);
+	int m0 = steep ? y1 : x1, n0 = steep ? x1 : y1;
+	int major = steep ? abs(y2 - y1) : abs(x2 - x1);
+	int minor = steep ? abs(x2 - x1) : abs(y2 - y1);
+	int sm = (steep ? y2 > y1 : x2 > x1) ? 1 : -1;
+	int sn = (steep ? x2 > x1 : y2 > y1) ? 1 : -1;
+	if (major == 0) return;
+
+	/* bounds along both axes, inclusive */
+	int mLo = steep ? clipTop : clipLeft, mHi = (steep ? clipBottom : clipRight) - 1;
+	int nLo = steep ? clipLeft : clipTop, nHi = (steep ? clipRight : clipBottom) - 1;
+
+	/* steps within the bounds along the major axis */
+	int64_t first = sm > 0 ? (int64_t)mLo - m0 : (int64_t)m0 - mHi;
+	int64_t last = sm > 0 ? (int64_t)mHi - m0 : (int64_t)m0 - mLo;
+	if (first < 0) first = 0;
+	if (last > major - 1) last = major - 1;
+
+	/* and along the minor axis, where the offset k(i) never decreases */
+	int64_t kLo = sn > 0 ? (int64_t)nLo - n0 : (int64_t)n0 - nHi;
+	int64_t kHi = sn > 0 ? (int64_t)nHi - n0 : (int64_t)n0 - nLo;
+	if (kHi < 0 || kLo > kHi) return;
+
+	if (minor == 0)
+	{
+		if (kLo > 0) return;
+	}
+	else
+	{
+		if (kLo > 0)
+		{
+			int64_t lo = (2 * (int64_t)major * kLo - major + 2 * (int64_t)minor - 1) / (2 * (int64_t)minor);
+			if (lo > first) first = lo;
+		}
+
+		int64_t hi = (2 * (int64_t)major * (kHi + 1) - major - 1) / (2 * (int64_t)minor);
+		if (hi < last) last = hi;
+	}
+
+	int64_t num = 2 * first * minor + major;
+	int64_t den = 2 * (int64_t)major;
+
+	if (visible.count == 1)
+	{
+		int m = m0 + sm * (int)first;
+		int n = n0 + sn * (int)(num / den);
+		WalkLine(pixels + (size_t)(steep ? m : n) * stride + (steep ? n : m), steep, sm, sn,
+			major, minor, num % den, (int)(last - first + 1), color);
+		return;
+	}
+
+	int k = (int)(num / den);
+	int64_t rem = num % den;
+
+	for (int64_t i = first; i <= last; i++)
+	{
+		int m = m0 + sm * (int)i;
+		int n = n0 + sn * k;
+		Plot(steep ? n : m, steep ? m : n, color);
+
+		rem += 2 * minor;
+		if (rem >= den)
+		{
+			rem -= den;
+			k++;
+		}
+	}
+}
+
+void MemoryGraphics::WalkLine(uint32_t *dst, bool steep, int sm, int sn, int major, int minor, int64_t rem, int count, uint32_t color)
+{
+	ptrdiff_t majorStep = steep ? sm * (ptrdiff_t)stride : sm;
+	ptrdiff_t minorStep = steep ? sn : sn * (ptrdiff_t)stride;
+	int64_t den = 2 * (int64_t)major;
+
+	if ((color >> 24) == 0xff)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			*dst = color;
+			dst += majorStep;
+
+			rem += 2 * minor;
+			if (rem >= den)
+			{
+				rem -= den;
+				dst += minorStep;
+			}
+		}
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		BlendSpan(dst, color, 1);
+		dst += majorStep;
+
+		rem += 2 * minor;
+		if (rem >= den)
+		{
+			rem -= den;
+			dst += minorStep;
+		}
+	}
+}
+
+void MemoryGraphics::SmoothLine(int x1, int y1, int x2, int y2, uint32_t color)
+{
+	/* Wu, two pixels across the line share its coverage. Whole pixels are
+	written where the line passes through their centers, so axis aligned
+	lines look the same as aliased ones */
+	bool steep = abs(y2 - y1) > abs(x2 - x1);
+	int m0 = steep ? y1 : x1, n0 = steep ? x1 : y1;
+	int major = steep ? abs(y2 - y1) : abs(x2 - x1);
+	int minor = steep ? abs(x2 - x1) : abs(y2 - y1);
+	int sm = (steep ? y2 > y1 : x2 > x1) ? 1 : -1;
+	int sn = (steep ? x2 > x1 : y2 > y1) ? 1 : -1;
+	if (major == 0) return;
+
+	/* steps within the bounds along the major axis */
+	int mLo = steep ? clipTop : clipLeft, mHi = (steep ? clipBottom : clipRight) - 1;
+	int64_t first = sm > 0 ? (int64_t)mLo - m0 : (int64_t)m0 - mHi;
+	int64_t last = sm > 0 ? (int64_t)mHi - m0 : (int64_t)m0 - mLo;
+	if (first < 0) first = 0;
+	if (last > major - 1) last = major - 1;
+
+	/* and, give or take a step, along the minor axis, where the pixels
+	k(i) and k(i) + 1 are covered */
+	int nLo = steep ? clipLeft : clipTop, nHi = (steep ? clipRight : clipBottom) - 1;
+	int64_t kLo = (sn > 0 ? (int64_t)nLo - n0 : (int64_t)n0 - nHi) - 1;
+	int64_t kHi = sn > 0 ? (int64_t)nHi - n0 : (int64_t)n0 - nLo;
+	if (kHi < 0 || kLo > kHi) return;
+
+	if (minor > 0)
+	{
+		if (kLo > 0)
+		{
+			int64_t lo = kLo * major / minor - 1;
+			if (lo > first) first = lo;
+		}
+
+		int64_t hi = (kHi + 1) * major / minor + 1;
+		if (hi < last) last = hi;
+	}
+
+	/* offset along the minor axis in 32.32 fixed point */
+	uint64_t step = ((uint64_t)minor << 32) / (uint64_t)major;
+	uint64_t pos = step * (uint64_t)first;
+	uint32_t alpha = color >> 24;
+	uint32_t rgb = color & 0x00ffffff;
+
+	for (int64_t i = first; i <= last; i++, pos += step)
+	{
+		int m = m0 + sm * (int)i;
+		int n = n0 + sn * (int)(pos >> 32);
+		uint32_t cover = (uint32_t)(pos >> 24) & 0xff;
+
+		uint32_t near = alpha * (255 - cover) + 128;
+		uint32_t far = alpha * cover + 128;
+		near = (near + (near >> 8)) >> 8;
+		far = (far + (far >> 8)) >> 8;
+
+		if (steep)
+		{
+			Plot(n, m, rgb | near << 24);
+			Plot(n + sn, m, rgb | far << 24);
+		}
+		else
+		{
+			Plot(m, n, rgb | near << 24);
+			Plot(m, n + sn, rgb | far << 24);
+		}
+	}
+}
+
+void MemoryGraphics::DrawLine(int x1, int y1, int x2, int y2)
+{
+	if (!pixels) return;
+	Line(x1, y1, x2, y2, lineColor);
+}
+
+void MemoryGraphics::DrawString(int x, int y, const char *string)
+{
+	if (!pixels) return;
+
+	/* extent of the text */
+	int w, h;
+	Font::GetBuiltin()->MeasureString(string, &w, &h);
+
+	if (!Visible(x, y, x + w, y + h))
+		return;
+
+	int penX = x;
+	for (const char *c = string; *c; c++)
+	{
+		if (*c == '\n')
+		{
+			penX = x;
+			y += FONT_LINE_HEIGHT;
+			continue;
+		}
+
+		const GlyphRuns *glyph = FontGlyphRuns((unsigned char)*c);
+		if (!glyph || penX + FONT_GLYPH_WIDTH <= clipLeft || penX >= clipRight ||
+			y + FONT_GLYPH_HEIGHT <= clipTop || y >= clipBottom)
+		{
+			/* no glyph, or outside of the clipping rectangle */
+		}
+		else if (visible.count == 1 && (lineColor >> 24) == 0xff && penX >= clipLeft && penX + FONT_GLYPH_WIDTH <= clipRight &&
+			y >= clipTop && y + FONT_GLYPH_HEIGHT <= clipBottom)
+		{
+			/* completely visible and opaque, write the spans directly */
+			uint32_t *origin = pixels + (size_t)y * stride + penX;
+			for (int i = 0; i < glyph->count; i++)
+			{
+				const GlyphSpan &span = glyph->spans[i];
+				uint32_t *row = origin + (size_t)span.row * stride;
+				for (int col = span.x0; col < span.x1; col++)
+					row[col] = lineColor;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < glyph->count; i++)
+			{
+				const GlyphSpan &span = glyph->spans[i];
+				Span(y + span.row, penX + span.x0, penX + span.x1, lineColor);
+			}
+		}
+
+		penX += FONT_ADVANCE;
+	}
+}
+
+//! \brief Interpolate between two pixels.
+//!
+//! \param [in] a The first pixel.
+//! \param [in] b The second pixel.
+//! \param [in] t The weight of the second pixel, in 256ths.
+//!
+//! \return The interpolated pixel.
+static inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t t)
+{
+	/* two channels at a time, each has 8 bits of headroom */
+	uint32_t rb = (((a & 0x00ff00ff) * (256 - t) + (b & 0x00ff00ff) * t) >> 8) & 0x00ff00ff;
+	uint32_t ag = (((a >> 8) & 0x00ff00ff) * (256 - t) + ((b >> 8) & 0x00ff00ff) * t) & 0xff00ff00;
+	return rb | ag;
+}
+
+void MemoryGraphics::FilterRow(uint32_t *dst, const uint32_t *src, int srcW, int count)
+{
+	const int *col = columns.data();
+	for (int n = 0; n < count; n++, col += 2)
+	{
+		int sx = col[0];
+		int next = sx + 1 < srcW ? sx + 1 : sx;
+		dst[n] = Lerp(src[sx], src[next], col[1]);
+	}
+}
+
+void MemoryGraphics::ImageRow(uint32_t *dst, const uint32_t *src, int count)
+{
+	if (blendMode == BLEND_SOURCE_OVER)
+	{
+		BlendPixels(dst, src, count);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+		dst[i] = src[i] | 0xff000000;
+}
+
+void MemoryGraphics::DrawImage(Image *image, int x, int y)
+{
+	if (!pixels || !image) return;
+
+	int w = image->GetWidth();
+	int h = image->GetHeight();
+	if (w <= 0 || h <= 0) return;
+	if (!Visible(x, y, x + w, y + h)) return;
+
+	const uint32_t *src = image->GetPixels();
+	int srcStride = image->GetStride();
+
+	for (int i = 0; i < visible.count; i++)
+	{
+		const Rect &rc = visible.rects[i];
+
+		int l = x > rc.x ? x : rc.x;
+		int t = y > rc.y ? y : rc.y;
+		int r = x + w < rc.x + rc.w ? x + w : rc.x + rc.w;
+		int b = y + h < rc.y + rc.h ? y + h : rc.y + rc.h;
+		if (l >= r || t >= b)
+			continue;
+
+		for (int row = t; row < b; row++)
+			ImageRow(pixels + (size_t)row * stride + l, src + (size_t)(row - y) * srcStride + (l - x), r - l);
+	}
+}
+
+void MemoryGraphics::DrawImage(Image *image, int x, int y, int w, int h, int filter)
+{
+	if (!pixels || !image) return;
+
+	int srcW = image->GetWidth();
+	int srcH = image->GetHeight();
+	if (srcW <= 0 || srcH <= 0 || w <= 0 || h <= 0) return;
+
+	if (w == srcW && h == srcH)
+	{
+		DrawImage(image, x, y);
+		return;
+	}
+
+	if (!Visible(x, y, x + w, y + h)) return;
+
+	const uint32_t *src = image->GetPixels();
+	int srcStride = image->GetStride();
+	bool blend = blendMode == BLEND_SOURCE_OVER;
+	uint32_t opaque = blend ? 0 : 0xff000000;
+
+	/* source coordinates in 16.16 fixed point, sampled at pixel centers */
+	int64_t stepX = ((int64_t)srcW << 16) / w;
+
+	for (int i = 0; i < visible.count; i++)
+	{
+		const Rect &rc = visible.rects[i];
+
+		int l = x > rc.x ? x : rc.x;
+		int t = y > rc.y ? y : rc.y;
+		int r = x + w < rc.x + rc.w ? x + w : rc.x + rc.w;
+		int b = y + h < rc.y + rc.h ? y + h : rc.y + rc.h;
+		if (l >= r || t >= b)
+			continue;
+
+		int count = r - l;
+		int64_t startX = ((int64_t)(2 * (l - x) + 1) * srcW << 15) / w;
+
+		if (filter != FILTER_BILINEAR)
+		{
+			if (blend && scratch.size() < (size_t)count)
+				scratch.resize(count);
+
+			for (int row = t; row < b; row++)
+			{
+				uint32_t *dst = pixels + (size_t)row * stride + l;
+				uint32_t *out = blend ? scratch.data() : dst;
+
+				int64_t v = ((int64_t)(2 * (row - y) + 1) * srcH << 15) / h;
+				const uint32_t *srcRow = src + (size_t)(v >> 16) * srcStride;
+
+				int64_t u = startX;
+				for (int n = 0; n < count; n++, u += stepX)
+					out[n] = srcRow[u >> 16] | opaque;
+
+				if (blend)
+					BlendPixels(dst, out, count);
+			}
+			continue;
+		}
+
+		/* the two nearest columns and the weight of the right one, clamped at
+		the edges, the same for every row */
+		if (columns.size() < 2 * (size_t)count)
+			columns.resize(2 * (size_t)count);
+
+		int64_t maxX = (int64_t)(srcW - 1) << 16;
+		int64_t u = startX - 0x8000;
+		for (int n = 0; n < count; n++, u += stepX)
+		{
+			int64_t cu = u < 0 ? 0 : u > maxX ? maxX : u;
+			columns[2 * n] = (int)(cu >> 16);
+			columns[2 * n + 1] = (int)(cu >> 8) & 0xff;
+		}
+
+		/* rows are filtered horizontally once, then shared by the output rows
+		between them */
+		if (scratch.size() < 3 * (size_t)count)
+			scratch.resize(3 * (size_t)count);
+
+		uint32_t *out = scratch.data();
+		uint32_t *upper = out + count;
+		uint32_t *lower = upper + count;
+		int upperY = -1, lowerY = -1;
+
+		for (int row = t; row < b; row++)
+		{
+			int64_t v = ((int64_t)(2 * (row - y) + 1) * srcH << 15) / h - 0x8000;
+			if (v < 0) v = 0;
+
+			int sy0 = (int)(v >> 16);
+			int sy1 = sy0 + 1 < srcH ? sy0 + 1 : sy0;
+			uint32_t ty = (uint32_t)(v >> 8) & 0xff;
+
+			if (sy0 != upperY)
+			{
+				if (sy0 == lowerY)
+				{
+					uint32_t *swap = upper;
+					upper = lower;
+					lower = swap;
+					upperY = lowerY;
+					lowerY = -1;
+				}
+				else
+				{
+					FilterRow(upper, src + (size_t)sy0 * srcStride, srcW, count);
+					upperY = sy0;
+				}
+			}
+
+			if (sy1 != lowerY)
+			{
+				FilterRow(lower, src + (size_t)sy1 * srcStride, srcW, count);
+				lowerY = sy1;
+			}
+
+			uint32_t *dst = pixels + (size_t)row * stride + l;
+			uint32_t *target = blend ? out : dst;
+			for (int n = 0; n < count; n++)
+				target[n] = Lerp(upper[n], lower[n], ty) | opaque;
+
+			if (blend)
+				BlendPixels(dst, out, count);
+		}
+	}
+}
+
+void MemoryGraphics::DrawSprites(SpriteAtlas *atlas, const SpriteInstance *instances, int count)
+{
+	if (!pixels || !atlas || count <= 0) return;
+
+	/* look everything up once, the loop makes no virtual calls for atlases
+	of the library */
+	SpriteTable table(atlas);
+	if (!table.image) return;
+
+	const uint32_t *src = table.image->GetPixels();
+	int srcStride = table.image->GetStride();
+
+	for (const SpriteInstance *inst = instances, *end = instances + count; inst < end; inst++)
+	{
+		const Rect *found = table.Find(inst->sprite);
+		if (!found)
+			continue;
+
+		const Rect &sprite = *found;
+		int x = inst->x, y = inst->y;
+
+		/* cull against the bounding box of the visible region */
+		if (x + sprite.w <= clipLeft || x >= clipRight || y + sprite.h <= clipTop || y >= clipBottom)
+			continue;
+
+		const uint32_t *origin = src + (size_t)sprite.y * srcStride + sprite.x;
+
+		for (int i = 0; i < visible.count; i++)
+		{
+			const Rect &rc = visible.rects[i];
+
+			int l = x > rc.x ? x : rc.x;
+			int t = y > rc.y ? y : rc.y;
+			int r = x + sprite.w < rc.x + rc.w ? x + sprite.w : rc.x + rc.w;
+			int b = y + sprite.h < rc.y + rc.h ? y + sprite.h : rc.y + rc.h;
+			if (l >= r || t >= b)
+				continue;
+
+			for (int row = t; row < b; row++)
+				ImageRow(pixels + (size_t)row * stride + l, origin + (size_t)(row - y) * srcStride + (l - x), r - l);
+		}
+	}
+}
+
+void MemoryGraphics::FillRects(const ColorRect *rects, int count)
+{
+	if (!pixels) return;
+
+	for (const ColorRect *rc = rects, *end = rects + count; rc < end; rc++)
+	{
+		if (rc->w <= 0 || rc->h <= 0)
+			continue;
+		if (!Visible(rc->x, rc->y, rc->x + rc->w, rc->y + rc->h))
+			continue;
+
+		/* outline and interior have the same color, so the whole rectangle is
+		one block */
+		Block(rc->x, rc->y, rc->x + rc->w, rc->y + rc->h, Resolve(rc->color.ToARGB()));
+	}
+}
+
+void MemoryGraphics::FillEllipses(const ColorRect *ellipses, int count)
+{
+	if (!pixels) return;
+
+	for (const ColorRect *rc = ellipses, *end = ellipses + count; rc < end; rc++)
+	{
+		uint32_t color = Resolve(rc->color.ToARGB());
+		Ellipse(rc->x, rc->y, rc->w, rc->h, color, color, true);
+	}
+}
+
+void MemoryGraphics::DrawLines(const ColorLine *lines, int count)
+{
+	if (!pixels) return;
+
+	for (const ColorLine *ln = lines, *end = lines + count; ln < end; ln++)
+		Line(ln->x1, ln->y1, ln->x2, ln->y2, Resolve(ln->color.ToARGB()));
+}
+
+void MemoryGraphics::DrawPolyline(const Point *points, int count)
+{
+	if (!pixels || count < 2) return;
+	if (!(lineColor >> 24)) return;
+
+	/* a segment with both ends inside the clipping bounds is inside them,
+	and is drawn without clipping. Whether a point is inside is found once,
+	for both segments it belongs to */
+	bool direct = !antialias && visible.count == 1;
+	bool inside = points[0].x >= clipLeft && points[0].x < clipRight && points[0].y >= clipTop && points[0].y < clipBottom;
+
+	for (int i = 1; i < count; i++)
+	{
+		const Point &a = points[i - 1];
+		const Point &b = points[i];
+		bool next = b.x >= clipLeft && b.x < clipRight && b.y >= clipTop && b.y < clipBottom;
+
+		if (direct && inside && next)
+		{
+			/* each segment excludes its end point, which the next one starts with */
+			int dx = abs(b.x - a.x), dy = abs(b.y - a.y);
+			bool steep = dy > dx;
+			int major = steep ? dy : dx;
+			if (major > 0)
+			{
+				WalkLine(pixels + (size_t)a.y * stride + a.x, steep,
+					(steep ? b.y > a.y : b.x > a.x) ? 1 : -1, (steep ? b.x > a.x : b.y > a.y) ? 1 : -1,
+					major, steep ? dx : dy, major, major, lineColor);
+			}
+		}
+		else
+			Line(a.x, a.y, b.x, b.y, lineColor);
+
+		inside = next;
+	}
+}
+
+void MemoryGraphics::SetClipRect(int x, int y, int w, int h)
+{
+	if (!pixels) return;
+
+	Rect parent = clipStack.empty() ? Rect{ 0, 0, width, height } : clipStack.back();
+	clip = RectIntersection({ x, y, w, h }, parent);
+	UpdateClip();
+}
+
+void MemoryGraphics::PushClipRect(int x, int y, int w, int h)
+{
+	if (!pixels) return;
+
+	clipStack.push_back(clip);
+	clip = RectIntersection({ x, y, w, h }, clip);
+	UpdateClip();
+}
+
+void MemoryGraphics::PopClipRect()
+{
+	if (!pixels) return;
+	if (clipStack.empty()) return;
+
+	clip = clipStack.back();
+	clipStack.pop_back();
+	UpdateClip();
+}
+
+void MemoryGraphics::SetLineColor(int r, int g, int b)
+{
+	SetLineColor(Color(r, g, b, 255));
+}
+
+void MemoryGraphics::SetLineColor(Color color)
+{
+	if (color.ToARGB() == lineSource)
+	{
+		stats.stateChangesElided++;
+		return;
+	}
+
+	lineSource = color.ToARGB();
+	lineColor = Resolve(lineSource);
+	stats.stateChanges++;
+}
+
+void MemoryGraphics::SetFillColor(int r, int g, int b)
+{
+	SetFillColor(Color(r, g, b, 255));
+}
+
+void MemoryGraphics::SetFillColor(Color color)
+{
+	if (color.ToARGB() == fillSource)
+	{
+		stats.stateChangesElided++;
+		return;
+	}
+
+	fillSource = color.ToARGB();
+	fillColor = Resolve(fillSource);
+	stats.stateChanges++;
+}
+
+void MemoryGraphics::SetColor(int r, int g, int b)
+{
+	SetColor(Color(r, g, b, 255));
+}
+
+void MemoryGraphics::SetColor(Color color)
+{
+	SetLineColor(color);
+	SetFillColor(color);
+}
+
+bool MemoryGraphics::GetColors(Color *const line, Color *const fill)
+{
+	if (line) *line = Color(lineSource);
+	if (fill) *fill = Color(fillSource);
+	return true;
+}
+
+void MemoryGraphics::SetBlendMode(int mode)
+{
+	if (mode == blendMode)
+	{
+		stats.stateChangesElided++;
+		return;
+	}
+
+	blendMode = mode;
+	UpdateColors();
+	stats.stateChanges++;
+}
+
+void MemoryGraphics::SetAntialiasing(bool enabled)
+{
+	if (enabled == antialias)
+	{
+		stats.stateChangesElided++;
+		return;
+	}
+
+	antialias = enabled;
+	stats.stateChanges++;
+}
+
+void MemoryGraphics::Clear()
+{
+	if (!pixels) return;
+
+	Block(0, 0, width, height, background);
+}
+
+void MemoryGraphics::Dispose()
+{
+	pixels = nullptr;
+}
+
+int MemoryGraphics::GetDirtyRects(Rect *const rects, int count)
+{
+	return dirty.Copy(rects, count);
+}
+
+bool MemoryGraphics::IsDirty(int x, int y, int w, int h)
+{
+	return dirty.Intersects({ x, y, w, h });
+}
+
+void MemoryGraphics::GetStats(GraphicsStats *const stats)
+{
+	*stats = this->stats;
+}
+
+Graphics *simplegui::Graphics::Create(uint32_t *pixels, int width, int height, int stride)
+{
+	return new MemoryGraphics(pixels, width, height, stride);
+}
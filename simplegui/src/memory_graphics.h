@@ -0,0 +1,242 @@
+#pragma once
+
+#include <simplegui.h>
+
+#include <vector>
+
+#include "region.h"
+
+//! \brief Software rasterizer which renders into a 32-bit 0xAARRGGBB
+//! framebuffer in memory.
+//!
+//! Primitives follow the same conventions as the GDI backend: rectangles and
+//! ellipses exclude their right and bottom edges, lines exclude their end
+//! point, and filled shapes are outlined with the line color.
+class MemoryGraphics : public simplegui::Graphics
+{
+public:
+	uint32_t *pixels;
+	int width, height;
+	int stride; // distance between rows, in pixels
+
+	int blendMode; // one of BLEND_*
+	uint32_t lineSource, fillSource; // colors as set, 0xAARRGGBB
+
+	/* pixel values drawn with, 0xAARRGGBB. Opaque unless blending, pixels
+	with a lower alpha are blended */
+	uint32_t lineColor;
+	uint32_t fillColor;
+	uint32_t background; // 0xAARRGGBB, used by Clear()
+	bool antialias; // whether lines are anti-aliased
+	simplegui::GraphicsStats stats;
+
+	simplegui::Rect clip; // current clipping rectangle
+	std::vector<simplegui::Rect> clipStack; // rectangles saved by PushClipRect()
+	DirtyRegion dirty; // region being repainted
+	DirtyRegion visible; // intersection of clip and dirty, drawing is restricted to this
+
+	/* bounding box of visible, right and bottom are exclusive */
+	int clipLeft, clipTop, clipRight, clipBottom;
+
+	/* buffers for scaling images, reused between calls */
+	std::vector<uint32_t> scratch; // rows of scaled pixels
+	std::vector<int> columns; // source columns and weights of bilinear filtering
+	std::vector<int> ellipse; // extent of the rows of an ellipse
+
+	/* rows of recently drawn small ellipses, by size */
+	static constexpr int ELLIPSE_CACHE_SIZE = 64; // power of two
+	static constexpr int ELLIPSE_CACHE_MAX = 128; // largest width and height cached
+	struct EllipseRows
+	{
+		int w, h; // 0 while unused
+		std::vector<int> inset; // first column of each row, relative to the left edge
+	};
+	EllipseRows ellipseCache[ELLIPSE_CACHE_SIZE];
+
+	MemoryGraphics(uint32_t *pixels, int width, int height, int stride);
+	virtual ~MemoryGraphics();
+
+	//! \brief Restrict drawing to a region which needs to be repainted.
+	//!
+	//! \param [in] region The region.
+	void SetDirtyRegion(const DirtyRegion &region);
+
+	//! \brief Take the colors, blend mode, clipping rectangles and counters of
+	//! another context, but not its dirty region.
+	//!
+	//! \param [in] other The context.
+	void CopyState(const MemoryGraphics &other);
+
+	//! \brief Recompute the visible region after the clipping rectangle or
+	//! dirty region has changed.
+	void UpdateClip();
+
+	//! \brief Test whether any part of a rectangle is visible, used to cull
+	//! primitives before rasterizing them.
+	//!
+	//! \param [in] x0 The first column.
+	//! \param [in] y0 The first row.
+	//! \param [in] x1 One past the last column.
+	//! \param [in] y1 One past the last row.
+	//!
+	//! \return true if the rectangle intersects the visible region.
+	bool Visible(int x0, int y0, int x1, int y1) const
+	{
+		if (x1 <= clipLeft || x0 >= clipRight || y1 <= clipTop || y0 >= clipBottom)
+			return false;
+		return visible.count == 1 || visible.Intersects({ x0, y0, x1 - x0, y1 - y0 });
+	}
+
+	//! \brief Convert a color to a framebuffer pixel.
+	//!
+	//! \param [in] color The color.
+	//!
+	//! \return The pixel value.
+	static uint32_t ToPixel(simplegui::Color color)
+	{
+		return color.ToARGB() | 0xff000000;
+	}
+
+	//! \brief Get the pixel value a color is drawn with in the current blend
+	//! mode.
+	//!
+	//! \param [in] argb The color, 0xAARRGGBB.
+	//!
+	//! \return The pixel value.
+	uint32_t Resolve(uint32_t argb) const
+	{
+		return blendMode == simplegui::BLEND_SOURCE_OVER ? argb : argb | 0xff000000;
+	}
+
+	//! \brief Compute the pixel values drawn with after the colors or the
+	//! blend mode have changed.
+	void UpdateColors();
+
+	//! \brief Fill a horizontal span, clipped against the clipping rectangle.
+	//!
+	//! \param [in] y The row.
+	//! \param [in] x0 The first column.
+	//! \param [in] x1 One past the last column.
+	//! \param [in] color The pixel value.
+	void Span(int y, int x0, int x1, uint32_t color);
+
+	//! \brief Fill a rectangular block, clipped against the clipping
+	//! rectangle.
+	//!
+	//! \param [in] x0 The first column.
+	//! \param [in] y0 The first row.
+	//! \param [in] x1 One past the last column.
+	//! \param [in] y1 One past the last row.
+	//! \param [in] color The pixel value.
+	void Block(int x0, int y0, int x1, int y1, uint32_t color);
+
+	//! \brief Set a single pixel, clipped against the clipping rectangle.
+	//!
+	//! \param [in] x The column.
+	//! \param [in] y The row.
+	//! \param [in] color The pixel value.
+	void Plot(int x, int y, uint32_t color);
+
+	//! \brief Draw a line, excluding its end point.
+	//!
+	//! \param [in] x1 The start x coordinate.
+	//! \param [in] y1 The start y coordinate.
+	//! \param [in] x2 The end x coordinate.
+	//! \param [in] y2 The end y coordinate.
+	//! \param [in] color The pixel value.
+	void Line(int x1, int y1, int x2, int y2, uint32_t color);
+
+	//! \brief Write the pixels of a line without clipping.
+	//!
+	//! \param [in] dst The first pixel.
+	//! \param [in] steep Whether the major axis is vertical.
+	//! \param [in] sm The direction along the major axis, 1 or -1.
+	//! \param [in] sn The direction along the minor axis, 1 or -1.
+	//! \param [in] major The length along the major axis.
+	//! \param [in] minor The length along the minor axis.
+	//! \param [in] rem The error term of the first pixel, in [0, 2 * major).
+	//! \param [in] count The number of pixels.
+	//! \param [in] color The pixel value.
+	void WalkLine(uint32_t *dst, bool steep, int sm, int sn, int major, int minor, int64_t rem, int count, uint32_t color);
+
+	//! \brief Draw an anti-aliased line, excluding its end point.
+	//!
+	//! \param [in] x1 The start x coordinate.
+	//! \param [in] y1 The start y coordinate.
+	//! \param [in] x2 The end x coordinate.
+	//! \param [in] y2 The end y coordinate.
+	//! \param [in] color The pixel value.
+	void SmoothLine(int x1, int y1, int x2, int y2, uint32_t color);
+
+	//! \brief Get the rows of an ellipse, cached for small ellipses.
+	//!
+	//! \param [in] w The width.
+	//! \param [in] h The height.
+	//! \param [in] first The first row needed.
+	//! \param [in] last One past the last row needed.
+	//!
+	//! \return The first column of each row, relative to the left edge, h
+	//! elements of which at least the ones needed are valid until the next
+	//! call.
+	const int *EllipseShape(int w, int h, int first, int last);
+
+	//! \brief Draw an ellipse.
+	//!
+	//! \param [in] x The x coordinate.
+	//! \param [in] y The y coordinate.
+	//! \param [in] w The width.
+	//! \param [in] h The height.
+	//! \param [in] line The pixel value of the outline.
+	//! \param [in] fill The pixel value of the interior.
+	//! \param [in] filled Whether to fill the interior, otherwise only the
+	//! outline is drawn.
+	void Ellipse(int x, int y, int w, int h, uint32_t line, uint32_t fill, bool filled);
+
+	//! \brief Write a row of image pixels, copied as opaque or blended
+	//! depending on the blend mode.
+	//!
+	//! \param [in] dst The first pixel.
+	//! \param [in] src The first image pixel.
+	//! \param [in] count The number of pixels.
+	void ImageRow(uint32_t *dst, const uint32_t *src, int count);
+
+	//! \brief Filter a row of an image horizontally with the columns computed
+	//! for bilinear scaling.
+	//!
+	//! \param [out] dst Receives the filtered pixels.
+	//! \param [in] src The image row.
+	//! \param [in] srcW The width of the image.
+	//! \param [in] count The number of pixels.
+	void FilterRow(uint32_t *dst, const uint32_t *src, int srcW, int count);
+
+	virtual void DrawRect(int x, int y, int w, int h) override;
+	virtual void FillRect(int x, int y, int w, int h) override;
+	virtual void DrawEllipse(int x, int y, int w, int h) override;
+	virtual void FillEllipse(int x, int y, int w, int h) override;
+	virtual void DrawLine(int x1, int y1, int x2, int y2) override;
+	virtual void DrawString(int x, int y, const char *string) override;
+	virtual void DrawImage(simplegui::Image *image, int x, int y) override;
+	virtual void DrawImage(simplegui::Image *image, int x, int y, int w, int h, int filter) override;
+	virtual void DrawSprites(simplegui::SpriteAtlas *atlas, const simplegui::SpriteInstance *instances, int count) override;
+	virtual void FillRects(const simplegui::ColorRect *rects, int count) override;
+	virtual void FillEllipses(const simplegui::ColorRect *ellipses, int count) override;
+	virtual void DrawLines(const simplegui::ColorLine *lines, int count) override;
+	virtual void DrawPolyline(const simplegui::Point *points, int count) override;
+	virtual void SetClipRect(int x, int y, int w, int h) override;
+	virtual void PushClipRect(int x, int y, int w, int h) override;
+	virtual void PopClipRect() override;
+	virtual void SetLineColor(int r, int g, int b) override;
+	virtual void SetLineColor(simplegui::Color color) override;
+	virtual void SetFillColor(int r, int g, int b) override;
+	virtual void SetFillColor(simplegui::Color color) override;
+	virtual void SetColor(int r, int g, int b) override;
+	virtual void SetColor(simplegui::Color color) override;
+	virtual bool GetColors(simplegui::Color *const line, simplegui::Color *const fill) override;
+	virtual void SetBlendMode(int mode) override;
+	virtual void SetAntialiasing(bool enabled) override;
+	virtual void Clear() override;
+	virtual void Dispose() override;
+	virtual int GetDirtyRects(simplegui::Rect *const rects, int count) override;
+	virtual bool IsDirty(int x, int y, int w, int h) override;
+	virtual void GetStats(simplegui::GraphicsStats *const stats) override;
+};
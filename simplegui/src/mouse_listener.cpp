@@ -5,3 +5,9 @@ void simplegui::MouseListener::MouseDown(Window *win, MouseEvent evt) { }
 void simplegui::MouseListener::MouseClick(Window *win, MouseEvent evt) { }
 void simplegui::MouseListener::MouseUp(Window *win, MouseEvent evt) { }
 void simplegui::MouseListener::MouseScroll(Window *win, int amount) { }
+
+void simplegui::MouseListener::MouseMovedBatch(Window *win, const MouseSample *samples, int count)
+{
+	/* only the latest position matters by default */
+	MouseMoved(win, samples[count - 1].x, samples[count - 1].y);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <simplegui.h>
+
+#include <cstddef>
+#include <vector>
+
+//! \brief Image backed by its own pixels or by pixels owned by the caller
+class PixelImage : public simplegui::Image
+{
+public:
+	std::vector<uint32_t> storage; // empty when wrapping pixels of the caller
+	uint32_t *pixels;
+	int width, height;
+	int stride; // distance between rows, in pixels
+
+	PixelImage(int width, int height) :
+		storage((size_t)width * height, 0),
+		pixels(storage.data()), width(width), height(height), stride(width)
+	{
+	}
+
+	PixelImage(uint32_t *pixels, int width, int height, int stride) :
+		pixels(pixels), width(width), height(height), stride(stride)
+	{
+	}
+
+	virtual uint32_t *GetPixels() override
+	{
+		return pixels;
+	}
+
+	virtual int GetWidth() override
+	{
+		return width;
+	}
+
+	virtual int GetHeight() override
+	{
+		return height;
+	}
+
+	virtual int GetStride() override
+	{
+		return stride;
+	}
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* built-in bitmap font used by the software rasterizer */
+
+static constexpr int FONT_FIRST_CHAR = 32;
+static constexpr int FONT_GLYPH_COUNT = 95;
+static constexpr int FONT_GLYPH_WIDTH = 5;
+static constexpr int FONT_GLYPH_HEIGHT = 8;
+static constexpr int FONT_ADVANCE = 6; // horizontal distance between glyphs
+static constexpr int FONT_LINE_HEIGHT = 10; // vertical distance between lines
+
+extern const uint8_t builtinFont[FONT_GLYPH_COUNT][FONT_GLYPH_HEIGHT];
+
+//! \brief Get the glyph for a character in the built-in font.
+//!
+//! \param [in] ch The character.
+//!
+//! \return The rows of the glyph, or null if the character has no glyph.
+inline const uint8_t *FontGlyph(unsigned char ch)
+{
+	if (ch < FONT_FIRST_CHAR || ch >= FONT_FIRST_CHAR + FONT_GLYPH_COUNT)
+		return nullptr;
+	return builtinFont[ch - FONT_FIRST_CHAR];
+}
+
+//! \brief A horizontal run of set pixels in a glyph.
+struct GlyphSpan
+{
+	uint8_t row;
+	uint8_t x0, x1; // first column and one past the last
+};
+
+//! \brief A glyph of the built-in font broken down into spans, so drawing
+//! it fills runs of pixels instead of testing every bit.
+struct GlyphRuns
+{
+	int count;
+	GlyphSpan spans[FONT_GLYPH_HEIGHT * ((FONT_GLYPH_WIDTH + 1) / 2)];
+};
+
+//! \brief Get the spans of a character in the built-in font. The spans of
+//! all glyphs are computed once, on first use.
+//!
+//! \param [in] ch The character.
+//!
+//! \return The spans, or null if the character has no glyph.
+const GlyphRuns *FontGlyphRuns(unsigned char ch);
+
+/* span-fill kernels, selected for the processor on first use. The pointers
+are atomic, as the first uses may happen on several threads at once */
+
+//! \brief Fill a run of pixels with a single value.
+//!
+//! \param [in] dst The first pixel.
+//! \param [in] color The pixel value.
+//! \param [in] count The number of pixels.
+extern std::atomic<void (*)(uint32_t *dst, uint32_t color, size_t count)> FillSpan;
+
+//! \brief Fill a rectangular block of pixels with a single value. Large
+//! blocks are written with non-temporal stores.
+//!
+//! \param [in] dst The top left pixel.
+//! \param [in] stride The distance between rows, in pixels.
+//! \param [in] color The pixel value.
+//! \param [in] w The width of the block.
+//! \param [in] h The height of the block.
+extern std::atomic<void (*)(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)> FillBlock;
+
+//! \brief Blend a single color over a run of pixels, source over
+//! destination. The color is premultiplied once, then every pixel is scaled
+//! by the inverse alpha and added to it.
+//!
+//! \param [in] dst The first pixel.
+//! \param [in] color The color, 0xAARRGGBB with straight alpha.
+//! \param [in] count The number of pixels.
+extern std::atomic<void (*)(uint32_t *dst, uint32_t color, size_t count)> BlendSpan;
+
+//! \brief Blend a single color over a rectangular block of pixels.
+//!
+//! \param [in] dst The top left pixel.
+//! \param [in] stride The distance between rows, in pixels.
+//! \param [in] color The color, 0xAARRGGBB with straight alpha.
+//! \param [in] w The width of the block.
+//! \param [in] h The height of the block.
+extern std::atomic<void (*)(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)> BlendBlock;
+
+//! \brief Blend a run of pixels with straight alpha over another, source over
+//! destination.
+//!
+//! \param [in] dst The first destination pixel.
+//! \param [in] src The first source pixel, 0xAARRGGBB.
+//! \param [in] count The number of pixels.
+extern std::atomic<void (*)(uint32_t *dst, const uint32_t *src, size_t count)> BlendPixels;
+
+//! \brief Select the kernels ahead of time, once per process. The first
+//! call through one of the kernels does the same.
+void ResolveKernels();
@@ -0,0 +1,97 @@
+#include "region.h"
+
+using namespace simplegui;
+
+static long long Area(const Rect &rc)
+{
+	return (long long)rc.w * rc.h;
+}
+
+void DirtyRegion::Add(Rect rc)
+{
+	if (rc.w <= 0 || rc.h <= 0)
+		return;
+
+	for (;;)
+	{
+		/* absorb every rectangle which overlaps the new one */
+		bool merged = false;
+		for (int i = 0; i < count; i++)
+		{
+			if (RectsOverlap(rects[i], rc))
+			{
+				rc = RectUnion(rects[i], rc);
+				rects[i] = rects[--count];
+				merged = true;
+				break;
+			}
+		}
+
+		if (merged)
+			continue;
+
+		if (count < MAX_RECTS)
+			break;
+
+		/* full, merge with the rectangle which wastes the least area */
+		int best = 0;
+		long long bestWaste = -1;
+		for (int i = 0; i < count; i++)
+		{
+			long long waste = Area(RectUnion(rects[i], rc)) - Area(rects[i]) - Area(rc);
+			if (bestWaste < 0 || waste < bestWaste)
+			{
+				best = i;
+				bestWaste = waste;
+			}
+		}
+
+		rc = RectUnion(rects[best], rc);
+		rects[best] = rects[--count];
+	}
+
+	rects[count++] = rc;
+}
+
+bool DirtyRegion::Intersects(const Rect &rc) const
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (RectsOverlap(rects[i], rc))
+			return true;
+	}
+	return false;
+}
+
+Rect DirtyRegion::Bounds() const
+{
+	if (!count)
+		return { 0, 0, 0, 0 };
+
+	Rect bounds = rects[0];
+	for (int i = 1; i < count; i++)
+		bounds = RectUnion(bounds, rects[i]);
+	return bounds;
+}
+
+void DirtyRegion::Intersect(const Rect &rc)
+{
+	int n = 0;
+	for (int i = 0; i < count; i++)
+	{
+		Rect clipped = RectIntersection(rects[i], rc);
+		if (clipped.w > 0 && clipped.h > 0)
+			rects[n++] = clipped;
+	}
+	count = n;
+}
+
+int DirtyRegion::Copy(Rect *const rects, int count) const
+{
+	if (rects)
+	{
+		for (int i = 0; i < count && i < this->count; i++)
+			rects[i] = this->rects[i];
+	}
+	return this->count;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <simplegui.h>
+
+//! \brief A small set of non-overlapping rectangles which need repainting.
+//! Rectangles which overlap are merged, and once the set is full the pair
+//! whose union wastes the least area is merged.
+class DirtyRegion
+{
+public:
+	static constexpr int MAX_RECTS = 8;
+
+	simplegui::Rect rects[MAX_RECTS];
+	int count;
+
+	DirtyRegion() :
+		count(0) { }
+
+	//! \brief Add a rectangle to the region.
+	//!
+	//! \param [in] rc The rectangle.
+	void Add(simplegui::Rect rc);
+
+	//! \brief Remove all rectangles from the region.
+	void Clear()
+	{
+		count = 0;
+	}
+
+	//! \brief Returns whether the region is empty.
+	bool IsEmpty() const
+	{
+		return count == 0;
+	}
+
+	//! \brief Test whether a rectangle intersects the region.
+	//!
+	//! \param [in] rc The rectangle.
+	//!
+	//! \return true if the rectangle intersects any rectangle in the region.
+	bool Intersects(const simplegui::Rect &rc) const;
+
+	//! \brief Get the bounding box of the region.
+	//!
+	//! \return The bounding box, or an empty rectangle if the region is empty.
+	simplegui::Rect Bounds() const;
+
+	//! \brief Clip every rectangle in the region against a rectangle,
+	//! dropping those which become empty.
+	//!
+	//! \param [in] rc The rectangle to clip against.
+	void Intersect(const simplegui::Rect &rc);
+
+	//! \brief Copy the rectangles in the region.
+	//!
+	//! \param [out] rects The destination. Optional.
+	//! \param [in] count The number of elements in rects.
+	//!
+	//! \return The number of rectangles in the region.
+	int Copy(simplegui::Rect *const rects, int count) const;
+};
+
+//! \brief Test whether two rectangles overlap.
+inline bool RectsOverlap(const simplegui::Rect &a, const simplegui::Rect &b)
+{
+	return a.x < b.x + b.w && b.x < a.x + a.w &&
+		a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+//! \brief Get the bounding box of two rectangles.
+inline simplegui::Rect RectUnion(const simplegui::Rect &a, const simplegui::Rect &b)
+{
+	int x0 = a.x < b.x ? a.x : b.x;
+	int y0 = a.y < b.y ? a.y : b.y;
+	int x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+	int y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+	return { x0, y0, x1 - x0, y1 - y0 };
+}
+
+//! \brief Get the intersection of two rectangles. The result has a width or
+//! height of 0 if they do not overlap.
+inline simplegui::Rect RectIntersection(const simplegui::Rect &a, const simplegui::Rect &b)
+{
+	int x0 = a.x > b.x ? a.x : b.x;
+	int y0 = a.y > b.y ? a.y : b.y;
+	int x1 = a.x + a.w < b.x + b.w ? a.x + a.w : b.x + b.w;
+	int y1 = a.y + a.h < b.y + b.h ? a.y + a.h : b.y + b.h;
+	if (x1 < x0) x1 = x0;
+	if (y1 < y0) y1 = y0;
+	return { x0, y0, x1 - x0, y1 - y0 };
+}
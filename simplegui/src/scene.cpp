@@ -0,0 +1,629 @@
+#include <simplegui.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "region.h"
+
+using namespace simplegui;
+
+/* cells of the spatial index are squares of 1 << CELL_SHIFT pixels */
+static constexpr int CELL_SHIFT = 6;
+
+/* nodes spanning more cells than this are kept out of the cells and tested
+on every paint instead */
+static constexpr int MAX_NODE_CELLS = 64;
+
+//! \brief Get the smallest rectangle enclosing two rectangles, either of
+//! which may be empty.
+static Rect Enclose(const Rect &a, const Rect &b)
+{
+	if (a.w <= 0 || a.h <= 0) return b;
+	if (b.w <= 0 || b.h <= 0) return a;
+	return RectUnion(a, b);
+}
+
+//! \brief Get the key of a cell of the spatial index.
+static inline uint64_t CellKey(int cx, int cy)
+{
+	return ((uint64_t)(uint32_t)cy << 32) | (uint32_t)cx;
+}
+
+class SceneGraph;
+
+//! \brief A node of a SceneGraph
+class Node : public SceneNode
+{
+public:
+	SceneGraph *scene;
+	Node *parent;
+	std::vector<Node *> children; // in drawing order, groups only
+	int type;
+	int x, y; // relative to the parent
+	int w, h; // measured for text
+	Color color;
+	std::string text;
+	Image *image; // not owned
+	bool visible;
+
+	/* derived from the above and the ancestors by SceneGraph::Layout() */
+	int left, top; // position in the window
+	bool shown; // whether the node and all of its ancestors are visible
+	Rect bounds; // area covered when shown
+	bool boundsValid; // cleared on groups when a descendant changes
+
+	/* spatial index, leaves only */
+	bool indexed, large;
+	int cellLeft, cellTop, cellRight, cellBottom; // inclusive
+	int order; // position in drawing order
+	uint32_t mark; // last paint which collected the node
+
+	Node(SceneGraph *scene, Node *parent, int type, int x, int y) :
+		scene(scene), parent(parent), type(type), x(x), y(y), w(0), h(0),
+		image(nullptr), visible(true),
+		left(x), top(y), shown(true), bounds({ 0, 0, 0, 0 }), boundsValid(true),
+		indexed(false), large(false), cellLeft(0), cellTop(0), cellRight(-1), cellBottom(-1),
+		order(0), mark(0)
+	{
+	}
+
+	virtual ~Node()
+	{
+		for (Node *child : children)
+			delete child;
+	}
+
+	virtual int GetType() override
+	{
+		return type;
+	}
+
+	virtual SceneNode *GetParent() override;
+	virtual void SetPos(int x, int y) override;
+	virtual void GetPos(int *const x, int *const y) override;
+	virtual void SetSize(int w, int h) override;
+	virtual void SetColor(Color color) override;
+	virtual void SetText(const char *text) override;
+	virtual void SetImage(Image *image) override;
+	virtual void SetVisible(bool visible) override;
+	virtual void GetBounds(Rect *const rect) override;
+};
+
+//! \brief Scene which keeps its leaves in a grid of cells, so a paint only
+//! visits the nodes near the dirty region
+class SceneGraph : public Scene
+{
+public:
+	Window *win;
+	std::mutex mutex; // never held while calling into the window
+	Node root;
+	std::unordered_map<uint64_t, std::vector<Node *>> cells; // leaves overlapping each cell
+	std::vector<Node *> large; // leaves spanning too many cells
+	std::vector<Node *> drawn; // leaves collected by a paint, reused
+	bool orderValid; // cleared when nodes are added or removed
+	uint32_t pass; // incremented for every paint
+	int blendMode;
+	SceneStats stats;
+
+	SceneGraph(Window *win) :
+		win(win), root(this, nullptr, NODE_GROUP, 0, 0),
+		orderValid(true), pass(0), blendMode(BLEND_NONE), stats()
+	{
+	}
+
+	virtual ~SceneGraph()
+	{
+	}
+
+	//! \brief Invalidate the part of the window a rectangle covers.
+	void Invalidate(const Rect &rc)
+	{
+		if (rc.w > 0 && rc.h > 0)
+			win->Invalidate(rc.x, rc.y, rc.w, rc.h);
+	}
+
+	//! \brief Get the area a node covers, which is empty if it is hidden.
+	Rect Covered(Node *node)
+	{
+		if (!node->shown)
+			return { 0, 0, 0, 0 };
+
+		return Bounds(node);
+	}
+
+	//! \brief Get the bounds of a node, bringing those of groups up to date.
+	const Rect &Bounds(Node *node)
+	{
+		if (!node->boundsValid)
+		{
+			Rect rc = { 0, 0, 0, 0 };
+			for (Node *child : node->children)
+			{
+				if (child->visible)
+					rc = Enclose(rc, Bounds(child));
+			}
+
+			node->bounds = rc;
+			node->boundsValid = true;
+		}
+
+		return node->bounds;
+	}
+
+	//! \brief Apply a change to a node under the lock, then invalidate what
+	//! the node covered before and covers after.
+	//!
+	//! \param [in] node The node.
+	//! \param [in] fn Changes the node.
+	template <typename Fn>
+	void Change(Node *node, Fn fn)
+	{
+		Rect before, after;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			before = Covered(node);
+			fn();
+			Update(node);
+			after = Covered(node);
+		}
+
+		Invalidate(before);
+		if (after.x != before.x || after.y != before.y || after.w != before.w || after.h != before.h)
+			Invalidate(after);
+	}
+
+	//! \brief Bring a changed node, its descendants and the index up to
+	//! date.
+	void Update(Node *node)
+	{
+		Node *p = node->parent;
+		Layout(node, p ? p->left : 0, p ? p->top : 0, p ? p->shown : true);
+
+		for (Node *a = p; a && a->boundsValid; a = a->parent)
+			a->boundsValid = false;
+	}
+
+	//! \brief Position a node and its descendants in the window.
+	//!
+	//! \param [in] node The node.
+	//! \param [in] originX The x position of the parent in the window.
+	//! \param [in] originY The y position of the parent in the window.
+	//! \param [in] parentShown Whether the parent is shown.
+	void Layout(Node *node, int originX, int originY, bool parentShown)
+	{
+		node->left = originX + node->x;
+		node->top = originY + node->y;
+		node->shown = parentShown && node->visible;
+
+		if (node->type == NODE_GROUP)
+		{
+			Rect rc = { 0, 0, 0, 0 };
+			for (Node *child : node->children)
+			{
+				Layout(child, node->left, node->top, node->shown);
+				if (child->visible)
+					rc = Enclose(rc, child->bounds);
+			}
+
+			node->bounds = rc;
+			node->boundsValid = true;
+			return;
+		}
+
+		bool empty = node->w <= 0 || node->h <= 0 || (node->type == NODE_IMAGE && !node->image);
+		node->bounds = { node->left, node->top, empty ? 0 : node->w, empty ? 0 : node->h };
+		Index(node);
+	}
+
+	//! \brief Put a leaf into the cells it overlaps, if it is shown.
+	void Index(Node *node)
+	{
+		const Rect &rc = node->bounds;
+		if (!node->shown || rc.w <= 0 || rc.h <= 0)
+		{
+			Unindex(node);
+			return;
+		}
+
+		int cl = rc.x >> CELL_SHIFT, ct = rc.y >> CELL_SHIFT;
+		int cr = (rc.x + rc.w - 1) >> CELL_SHIFT, cb = (rc.y + rc.h - 1) >> CELL_SHIFT;
+		bool isLarge = (int64_t)(cr - cl + 1) * (cb - ct + 1) > MAX_NODE_CELLS;
+
+		/* most changes, like colors, do not move the node to other cells */
+		if (node->indexed && node->large == isLarge &&
+			(isLarge || (node->cellLeft == cl && node->cellTop == ct && node->cellRight == cr && node->cellBottom == cb)))
+			return;
+
+		Unindex(node);
+
+		node->indexed = true;
+		node->large = isLarge;
+		node->cellLeft = cl;
+		node->cellTop = ct;
+		node->cellRight = cr;
+		node->cellBottom = cb;
+
+		if (isLarge)
+		{
+			large.push_back(node);
+			return;
+		}
+
+		for (int cy = ct; cy <= cb; cy++)
+			for (int cx = cl; cx <= cr; cx++)
+				cells[CellKey(cx, cy)].push_back(node);
+	}
+
+	//! \brief Take a leaf out of the index.
+	void Unindex(Node *node)
+	{
+		if (!node->indexed)
+			return;
+
+		node->indexed = false;
+
+		if (node->large)
+		{
+			Erase(large, node);
+			return;
+		}
+
+		for (int cy = node->cellTop; cy <= node->cellBottom; cy++)
+		{
+			for (int cx = node->cellLeft; cx <= node->cellRight; cx++)
+			{
+				auto it = cells.find(CellKey(cx, cy));
+				if (it == cells.end())
+					continue;
+
+				Erase(it->second, node);
+				if (it->second.empty())
+					cells.erase(it);
+			}
+		}
+	}
+
+	//! \brief Remove a node from a list, not keeping the order.
+	static void Erase(std::vector<Node *> &list, Node *node)
+	{
+		auto it = std::find(list.begin(), list.end(), node);
+		if (it == list.end())
+			return;
+
+		*it = list.back();
+		list.pop_back();
+	}
+
+	//! \brief Take a node and its descendants out of the index.
+	void UnindexAll(Node *node)
+	{
+		Unindex(node);
+		for (Node *child : node->children)
+			UnindexAll(child);
+	}
+
+	//! \brief Count a node and its descendants.
+	static uint64_t CountAll(Node *node)
+	{
+		uint64_t n = 1;
+		for (Node *child : node->children)
+			n += CountAll(child);
+		return n;
+	}
+
+	//! \brief Number the leaves in drawing order.
+	void Renumber(Node *node, int *const next)
+	{
+		node->order = (*next)++;
+		for (Node *child : node->children)
+			Renumber(child, next);
+	}
+
+	//! \brief Add a node to a group.
+	//!
+	//! \param [in] parent The group, or null for the root.
+	//! \param [in] node The node, deleted if the parent is not a group.
+	//!
+	//! \return The node, or null.
+	SceneNode *Add(SceneNode *parent, Node *node)
+	{
+		Rect after;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			Node *p = parent ? static_cast<Node *>(parent) : &root;
+			if (p->type != NODE_GROUP)
+			{
+				delete node;
+				return nullptr;
+			}
+
+			node->parent = p;
+			p->children.push_back(node);
+			orderValid = false;
+			stats.nodes++;
+
+			Update(node);
+			after = Covered(node);
+		}
+
+		Invalidate(after);
+		return node;
+	}
+
+	virtual SceneNode *GetRoot() override
+	{
+		return &root;
+	}
+
+	virtual SceneNode *AddRect(SceneNode *parent, int x, int y, int w, int h, Color color) override
+	{
+		Node *node = new Node(this, nullptr, NODE_RECT, x, y);
+		node->w = w;
+		node->h = h;
+		node->color = color;
+		return Add(parent, node);
+	}
+
+	virtual SceneNode *AddEllipse(SceneNode *parent, int x, int y, int w, int h, Color color) override
+	{
+		Node *node = new Node(this, nullptr, NODE_ELLIPSE, x, y);
+		node->w = w;
+		node->h = h;
+		node->color = color;
+		return Add(parent, node);
+	}
+
+	virtual SceneNode *AddText(SceneNode *parent, int x, int y, const char *text, Color color) override
+	{
+		Node *node = new Node(this, nullptr, NODE_TEXT, x, y);
+		node->text = text ? text : "";
+		node->color = color;
+		win->GetFont()->MeasureString(node->text.c_str(), &node->w, &node->h);
+		return Add(parent, node);
+	}
+
+	virtual SceneNode *AddImage(SceneNode *parent, int x, int y, Image *image) override
+	{
+		Node *node = new Node(this, nullptr, NODE_IMAGE, x, y);
+		node->image = image;
+		node->w = image ? image->GetWidth() : 0;
+		node->h = image ? image->GetHeight() : 0;
+		return Add(parent, node);
+	}
+
+	virtual SceneNode *AddGroup(SceneNode *parent, int x, int y) override
+	{
+		return Add(parent, new Node(this, nullptr, NODE_GROUP, x, y));
+	}
+
+	virtual void Remove(SceneNode *node) override
+	{
+		Node *n = static_cast<Node *>(node);
+		if (!n || n == &root)
+			return;
+
+		Rect before;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			before = Covered(n);
+			UnindexAll(n);
+
+			Node *p = n->parent;
+			p->children.erase(std::find(p->children.begin(), p->children.end(), n));
+			for (Node *a = p; a && a->boundsValid; a = a->parent)
+				a->boundsValid = false;
+
+			stats.nodes -= CountAll(n);
+			delete n;
+		}
+
+		Invalidate(before);
+	}
+
+	virtual void SetBlendMode(int mode) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (blendMode == mode)
+				return;
+
+			blendMode = mode;
+		}
+
+		win->Invalidate();
+	}
+
+	virtual void GetStats(SceneStats *const stats) override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		*stats = this->stats;
+	}
+
+	//! \brief Draw a leaf.
+	static void Draw(Graphics *g, Node *node)
+	{
+		switch (node->type)
+		{
+		case NODE_RECT:
+			g->SetColor(node->color);
+			g->FillRect(node->left, node->top, node->w, node->h);
+			break;
+		case NODE_ELLIPSE:
+			g->SetColor(node->color);
+			g->FillEllipse(node->left, node->top, node->w, node->h);
+			break;
+		case NODE_TEXT:
+			g->SetColor(node->color);
+			g->DrawString(node->left, node->top, node->text.c_str());
+			break;
+		case NODE_IMAGE:
+			if (node->w == node->image->GetWidth() && node->h == node->image->GetHeight())
+				g->DrawImage(node->image, node->left, node->top);
+			else
+				g->DrawImage(node->image, node->left, node->top, node->w, node->h, FILTER_BILINEAR);
+			break;
+		}
+	}
+
+	virtual void Paint(Window *win, Graphics *g) override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!orderValid)
+		{
+			int next = 0;
+			Renumber(&root, &next);
+			orderValid = true;
+		}
+
+		/* without a region, or with more rectangles than fit, the whole
+		window is dirty */
+		Rect rects[DirtyRegion::MAX_RECTS];
+		int count = g->GetDirtyRects(rects, DirtyRegion::MAX_RECTS);
+		if (count <= 0 || count > DirtyRegion::MAX_RECTS)
+		{
+			int w = 0, h = 0;
+			win->GetSize(&w, &h);
+			rects[0] = { 0, 0, w, h };
+			count = 1;
+		}
+
+		/* each dirty rectangle collects the leaves in the cells it touches,
+		and the leaves are drawn in tree order */
+		pass++;
+		drawn.clear();
+
+		for (int i = 0; i < count; i++)
+		{
+			const Rect &rc = rects[i];
+			if (rc.w <= 0 || rc.h <= 0)
+				continue;
+
+			for (Node *node : large)
+			{
+				if (node->mark != pass && RectsOverlap(node->bounds, rc))
+				{
+					node->mark = pass;
+					drawn.push_back(node);
+				}
+			}
+
+			int cl = rc.x >> CELL_SHIFT, ct = rc.y >> CELL_SHIFT;
+			int cr = (rc.x + rc.w - 1) >> CELL_SHIFT, cb = (rc.y + rc.h - 1) >> CELL_SHIFT;
+			for (int cy = ct; cy <= cb; cy++)
+			{
+				for (int cx = cl; cx <= cr; cx++)
+				{
+					auto it = cells.find(CellKey(cx, cy));
+					if (it == cells.end())
+						continue;
+
+					for (Node *node : it->second)
+					{
+						if (node->mark != pass && RectsOverlap(node->bounds, rc))
+						{
+							node->mark = pass;
+							drawn.push_back(node);
+						}
+					}
+				}
+			}
+		}
+
+		std::sort(drawn.begin(), drawn.end(), [](const Node *a, const Node *b) { return a->order < b->order; });
+
+		g->SetBlendMode(blendMode);
+		g->Clear();
+		for (Node *node : drawn)
+			Draw(g, node);
+
+		stats.painted = drawn.size();
+	}
+};
+
+SceneNode *Node::GetParent()
+{
+	std::lock_guard<std::mutex> lock(scene->mutex);
+	return parent;
+}
+
+void Node::SetPos(int x, int y)
+{
+	scene->Change(this, [&] { this->x = x; this->y = y; });
+}
+
+void Node::GetPos(int *const x, int *const y)
+{
+	std::lock_guard<std::mutex> lock(scene->mutex);
+	if (x) *x = this->x;
+	if (y) *y = this->y;
+}
+
+void Node::SetSize(int w, int h)
+{
+	if (type != NODE_RECT && type != NODE_ELLIPSE && type != NODE_IMAGE)
+		return;
+
+	scene->Change(this, [&] { this->w = w; this->h = h; });
+}
+
+void Node::SetColor(Color color)
+{
+	if (type != NODE_RECT && type != NODE_ELLIPSE && type != NODE_TEXT)
+		return;
+
+	scene->Change(this, [&] { this->color = color; });
+}
+
+void Node::SetText(const char *text)
+{
+	if (type != NODE_TEXT)
+		return;
+
+	/* measured before taking the lock, the window is never called under it */
+	std::string s = text ? text : "";
+	int w = 0, h = 0;
+	scene->win->GetFont()->MeasureString(s.c_str(), &w, &h);
+
+	scene->Change(this, [&] { this->text.swap(s); this->w = w; this->h = h; });
+}
+
+void Node::SetImage(Image *image)
+{
+	if (type != NODE_IMAGE)
+		return;
+
+	scene->Change(this, [&] {
+		this->image = image;
+		w = image ? image->GetWidth() : 0;
+		h = image ? image->GetHeight() : 0;
+	});
+}
+
+void Node::SetVisible(bool visible)
+{
+	scene->Change(this, [&] { this->visible = visible; });
+}
+
+void Node::GetBounds(Rect *const rect)
+{
+	std::lock_guard<std::mutex> lock(scene->mutex);
+	*rect = scene->Bounds(this);
+}
+
+simplegui::SceneNode::SceneNode() { }
+simplegui::SceneNode::~SceneNode() { }
+
+simplegui::Scene::Scene() { }
+simplegui::Scene::~Scene() { }
+
+Scene *simplegui::Scene::Create(Window *win)
+{
+	return new SceneGraph(win);
+}
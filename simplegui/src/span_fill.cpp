@@ -0,0 +1,497 @@
+#include "raster.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMPLEGUI_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/* fills larger than this bypass the cache with non-temporal stores */
+static constexpr size_t STREAM_THRESHOLD = 1 << 20; // bytes
+
+static void FillSpanScalar(uint32_t *dst, uint32_t color, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] = color;
+}
+
+static void FillBlockScalar(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	for (size_t row = 0; row < h; row++, dst += stride)
+		FillSpanScalar(dst, color, w);
+}
+
+//! \brief Divide by 255, rounded to nearest, for products of two bytes.
+static inline uint32_t Div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+//! \brief Premultiply a color by its alpha.
+static inline uint32_t Premultiply(uint32_t color)
+{
+	uint32_t a = color >> 24;
+	return (a << 24) |
+		(Div255(((color >> 16) & 0xff) * a) << 16) |
+		(Div255(((color >> 8) & 0xff) * a) << 8) |
+		Div255((color & 0xff) * a);
+}
+
+static void BlendSpanScalarImpl(uint32_t *dst, uint32_t src, uint32_t inv, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t d = dst[i];
+		dst[i] =
+			((((src >> 24) & 0xff) + Div255(((d >> 24) & 0xff) * inv)) << 24) |
+			((((src >> 16) & 0xff) + Div255(((d >> 16) & 0xff) * inv)) << 16) |
+			((((src >> 8) & 0xff) + Div255(((d >> 8) & 0xff) * inv)) << 8) |
+			((src & 0xff) + Div255((d & 0xff) * inv));
+	}
+}
+
+static void BlendSpanScalar(uint32_t *dst, uint32_t color, size_t count)
+{
+	BlendSpanScalarImpl(dst, Premultiply(color), 255 - (color >> 24), count);
+}
+
+static void BlendBlockScalar(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	uint32_t src = Premultiply(color);
+	uint32_t inv = 255 - (color >> 24);
+
+	for (size_t row = 0; row < h; row++, dst += stride)
+		BlendSpanScalarImpl(dst, src, inv, w);
+}
+
+static void BlendPixelsScalar(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t s = src[i];
+		uint32_t a = s >> 24;
+		if (a == 0xff)
+		{
+			dst[i] = s;
+			continue;
+		}
+		if (!a)
+			continue;
+
+		uint32_t d = dst[i];
+		uint32_t inv = 255 - a;
+		dst[i] =
+			((a + Div255(((d >> 24) & 0xff) * inv)) << 24) |
+			((Div255(((s >> 16) & 0xff) * a) + Div255(((d >> 16) & 0xff) * inv)) << 16) |
+			((Div255(((s >> 8) & 0xff) * a) + Div255(((d >> 8) & 0xff) * inv)) << 8) |
+			(Div255((s & 0xff) * a) + Div255((d & 0xff) * inv));
+	}
+}
+
+#if SIMPLEGUI_X86
+
+TARGET_SSE2 static inline void FillSpanSse2Impl(uint32_t *dst, uint32_t color, size_t count, bool stream)
+{
+	/* align to 16 bytes */
+	while (count && ((uintptr_t)dst & 15))
+	{
+		*dst++ = color;
+		count--;
+	}
+
+	__m128i v = _mm_set1_epi32((int)color);
+	if (stream)
+	{
+		for (; count >= 16; count -= 16, dst += 16)
+		{
+			_mm_stream_si128((__m128i *)dst, v);
+			_mm_stream_si128((__m128i *)(dst + 4), v);
+			_mm_stream_si128((__m128i *)(dst + 8), v);
+			_mm_stream_si128((__m128i *)(dst + 12), v);
+		}
+	}
+	else
+	{
+		for (; count >= 16; count -= 16, dst += 16)
+		{
+			_mm_store_si128((__m128i *)dst, v);
+			_mm_store_si128((__m128i *)(dst + 4), v);
+			_mm_store_si128((__m128i *)(dst + 8), v);
+			_mm_store_si128((__m128i *)(dst + 12), v);
+		}
+	}
+
+	for (; count >= 4; count -= 4, dst += 4)
+		_mm_store_si128((__m128i *)dst, v);
+
+	while (count--)
+		*dst++ = color;
+}
+
+TARGET_SSE2 static void FillSpanSse2(uint32_t *dst, uint32_t color, size_t count)
+{
+	if (count < 8)
+		FillSpanScalar(dst, color, count);
+	else
+		FillSpanSse2Impl(dst, color, count, false);
+}
+
+TARGET_SSE2 static void FillBlockSse2(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	bool stream = w * h * sizeof(uint32_t) >= STREAM_THRESHOLD;
+
+	/* contiguous rows are filled as a single span */
+	if (stride == w)
+	{
+		w *= h;
+		h = 1;
+	}
+
+	for (size_t row = 0; row < h; row++, dst += stride)
+		FillSpanSse2Impl(dst, color, w, stream);
+
+	if (stream)
+		_mm_sfence();
+}
+
+//! \brief Divide 16-bit products of two bytes by 255, rounded to nearest.
+TARGET_SSE2 static inline __m128i Div255Sse2(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+//! \brief Blend four pixels, widened to 16 bits per channel.
+TARGET_SSE2 static inline __m128i Blend4Sse2(__m128i px, __m128i src, __m128i inv)
+{
+	__m128i zero = _mm_setzero_si128();
+
+	__m128i lo = Div255Sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), inv));
+	__m128i hi = Div255Sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), inv));
+
+	return _mm_packus_epi16(_mm_add_epi16(lo, src), _mm_add_epi16(hi, src));
+}
+
+//! \brief Blend two pixels of straight alpha over two others, widened to 16
+//! bits per channel.
+TARGET_SSE2 static inline __m128i BlendPixels2Sse2(__m128i s, __m128i d)
+{
+	/* the alpha channel of the source is kept, not multiplied by itself */
+	__m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	__m128i mul = _mm_or_si128(_mm_andnot_si128(alphaLanes, a), _mm_and_si128(alphaLanes, _mm_set1_epi16(255)));
+
+	return _mm_add_epi16(Div255Sse2(_mm_mullo_epi16(s, mul)), Div255Sse2(_mm_mullo_epi16(d, inv)));
+}
+
+TARGET_SSE2 static void BlendPixelsSse2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	__m128i zero = _mm_setzero_si128();
+
+	for (; count >= 4; count -= 4, dst += 4, src += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)src);
+		__m128i d = _mm_loadu_si128((const __m128i *)dst);
+
+		__m128i lo = BlendPixels2Sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = BlendPixels2Sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		_mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+	}
+
+	BlendPixelsScalar(dst, src, count);
+}
+
+TARGET_SSE2 static void BlendSpanSse2Impl(uint32_t *dst, uint32_t src, uint32_t inv, size_t count)
+{
+	__m128i vsrc = _mm_unpacklo_epi8(_mm_set1_epi32((int)src), _mm_setzero_si128());
+	__m128i vinv = _mm_set1_epi16((short)inv);
+
+	for (; count >= 4; count -= 4, dst += 4)
+		_mm_storeu_si128((__m128i *)dst, Blend4Sse2(_mm_loadu_si128((const __m128i *)dst), vsrc, vinv));
+
+	BlendSpanScalarImpl(dst, src, inv, count);
+}
+
+TARGET_SSE2 static void BlendSpanSse2(uint32_t *dst, uint32_t color, size_t count)
+{
+	BlendSpanSse2Impl(dst, Premultiply(color), 255 - (color >> 24), count);
+}
+
+TARGET_SSE2 static void BlendBlockSse2(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	uint32_t src = Premultiply(color);
+	uint32_t inv = 255 - (color >> 24);
+
+	for (size_t row = 0; row < h; row++, dst += stride)
+		BlendSpanSse2Impl(dst, src, inv, w);
+}
+
+TARGET_AVX2 static inline void FillSpanAvx2Impl(uint32_t *dst, uint32_t color, size_t count, bool stream)
+{
+	/* align to 32 bytes */
+	while (count && ((uintptr_t)dst & 31))
+	{
+		*dst++ = color;
+		count--;
+	}
+
+	__m256i v = _mm256_set1_epi32((int)color);
+	if (stream)
+	{
+		for (; count >= 32; count -= 32, dst += 32)
+		{
+			_mm256_stream_si256((__m256i *)dst, v);
+			_mm256_stream_si256((__m256i *)(dst + 8), v);
+			_mm256_stream_si256((__m256i *)(dst + 16), v);
+			_mm256_stream_si256((__m256i *)(dst + 24), v);
+		}
+	}
+	else
+	{
+		for (; count >= 32; count -= 32, dst += 32)
+		{
+			_mm256_store_si256((__m256i *)dst, v);
+			_mm256_store_si256((__m256i *)(dst + 8), v);
+			_mm256_store_si256((__m256i *)(dst + 16), v);
+			_mm256_store_si256((__m256i *)(dst + 24), v);
+		}
+	}
+
+	for (; count >= 8; count -= 8, dst += 8)
+		_mm256_store_si256((__m256i *)dst, v);
+
+	while (count--)
+		*dst++ = color;
+}
+
+TARGET_AVX2 static void FillSpanAvx2(uint32_t *dst, uint32_t color, size_t count)
+{
+	if (count < 16)
+		FillSpanScalar(dst, color, count);
+	else
+		FillSpanAvx2Impl(dst, color, count, false);
+}
+
+TARGET_AVX2 static void FillBlockAvx2(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	bool stream = w * h * sizeof(uint32_t) >= STREAM_THRESHOLD;
+
+	/* contiguous rows are filled as a single span */
+	if (stride == w)
+	{
+		w *= h;
+		h = 1;
+	}
+
+	for (size_t row = 0; row < h; row++, dst += stride)
+		FillSpanAvx2Impl(dst, color, w, stream);
+
+	if (stream)
+		_mm_sfence();
+}
+
+//! \brief Divide 16-bit products of two bytes by 255, rounded to nearest.
+TARGET_AVX2 static inline __m256i Div255Avx2(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+//! \brief Blend eight pixels, widened to 16 bits per channel.
+TARGET_AVX2 static inline __m256i Blend8Avx2(__m256i px, __m256i src, __m256i inv)
+{
+	__m256i zero = _mm256_setzero_si256();
+
+	/* unpacking works within 128-bit lanes, packing undoes it */
+	__m256i lo = Div255Avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(px, zero), inv));
+	__m256i hi = Div255Avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(px, zero), inv));
+
+	return _mm256_packus_epi16(_mm256_add_epi16(lo, src), _mm256_add_epi16(hi, src));
+}
+
+//! \brief Blend four pixels of straight alpha over four others, widened to
+//! 16 bits per channel.
+TARGET_AVX2 static inline __m256i BlendPixels4Avx2(__m256i s, __m256i d)
+{
+	/* the alpha channel of the source is kept, not multiplied by itself */
+	__m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+	__m256i mul = _mm256_or_si256(_mm256_andnot_si256(alphaLanes, a), _mm256_and_si256(alphaLanes, _mm256_set1_epi16(255)));
+
+	return _mm256_add_epi16(Div255Avx2(_mm256_mullo_epi16(s, mul)), Div255Avx2(_mm256_mullo_epi16(d, inv)));
+}
+
+TARGET_AVX2 static void BlendPixelsAvx2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	__m256i zero = _mm256_setzero_si256();
+
+	for (; count >= 8; count -= 8, dst += 8, src += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)src);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+
+		__m256i lo = BlendPixels4Avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = BlendPixels4Avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		_mm256_storeu_si256((__m256i *)dst, _mm256_packus_epi16(lo, hi));
+	}
+
+	BlendPixelsScalar(dst, src, count);
+}
+
+TARGET_AVX2 static void BlendSpanAvx2Impl(uint32_t *dst, uint32_t src, uint32_t inv, size_t count)
+{
+	__m256i vsrc = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)src), _mm256_setzero_si256());
+	__m256i vinv = _mm256_set1_epi16((short)inv);
+
+	for (; count >= 8; count -= 8, dst += 8)
+		_mm256_storeu_si256((__m256i *)dst, Blend8Avx2(_mm256_loadu_si256((const __m256i *)dst), vsrc, vinv));
+
+	BlendSpanScalarImpl(dst, src, inv, count);
+}
+
+TARGET_AVX2 static void BlendSpanAvx2(uint32_t *dst, uint32_t color, size_t count)
+{
+	BlendSpanAvx2Impl(dst, Premultiply(color), 255 - (color >> 24), count);
+}
+
+TARGET_AVX2 static void BlendBlockAvx2(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	uint32_t src = Premultiply(color);
+	uint32_t inv = 255 - (color >> 24);
+
+	for (size_t row = 0; row < h; row++, dst += stride)
+		BlendSpanAvx2Impl(dst, src, inv, w);
+}
+
+//! \brief Check whether the processor and operating system support AVX2.
+static bool CpuHasAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	/* OSXSAVE and AVX */
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+
+	/* OS saves XMM and YMM state */
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+//! \brief Check whether the processor supports SSE2.
+static bool CpuHasSse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+//! \brief Select the fastest kernels for this processor.
+static void SelectKernels()
+{
+	FillSpan = &FillSpanScalar;
+	FillBlock = &FillBlockScalar;
+	BlendSpan = &BlendSpanScalar;
+	BlendBlock = &BlendBlockScalar;
+	BlendPixels = &BlendPixelsScalar;
+
+#if SIMPLEGUI_X86
+	if (CpuHasAvx2())
+	{
+		FillSpan = &FillSpanAvx2;
+		FillBlock = &FillBlockAvx2;
+		BlendSpan = &BlendSpanAvx2;
+		BlendBlock = &BlendBlockAvx2;
+		BlendPixels = &BlendPixelsAvx2;
+	}
+	else if (CpuHasSse2())
+	{
+		FillSpan = &FillSpanSse2;
+		FillBlock = &FillBlockSse2;
+		BlendSpan = &BlendSpanSse2;
+		BlendBlock = &BlendBlockSse2;
+		BlendPixels = &BlendPixelsSse2;
+	}
+#endif
+}
+
+void ResolveKernels()
+{
+	static const bool selected = (SelectKernels(), true);
+	(void)selected;
+}
+
+/* the first call through a kernel pointer selects the implementations,
+once, even if it happens on several threads at once */
+
+static void FillSpanResolve(uint32_t *dst, uint32_t color, size_t count)
+{
+	ResolveKernels();
+	FillSpan(dst, color, count);
+}
+
+static void FillBlockResolve(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	ResolveKernels();
+	FillBlock(dst, stride, color, w, h);
+}
+
+static void BlendSpanResolve(uint32_t *dst, uint32_t color, size_t count)
+{
+	ResolveKernels();
+	BlendSpan(dst, color, count);
+}
+
+static void BlendBlockResolve(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)
+{
+	ResolveKernels();
+	BlendBlock(dst, stride, color, w, h);
+}
+
+static void BlendPixelsResolve(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	ResolveKernels();
+	BlendPixels(dst, src, count);
+}
+
+std::atomic<void (*)(uint32_t *dst, uint32_t color, size_t count)> FillSpan(&FillSpanResolve);
+std::atomic<void (*)(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)> FillBlock(&FillBlockResolve);
+std::atomic<void (*)(uint32_t *dst, uint32_t color, size_t count)> BlendSpan(&BlendSpanResolve);
+std::atomic<void (*)(uint32_t *dst, size_t stride, uint32_t color, size_t w, size_t h)> BlendBlock(&BlendBlockResolve);
+std::atomic<void (*)(uint32_t *dst, const uint32_t *src, size_t count)> BlendPixels(&BlendPixelsResolve);
@@ -0,0 +1,83 @@
+#include "sprite_atlas.h"
+
+#include <cstring>
+
+using namespace simplegui;
+
+PackedAtlas::PackedAtlas(int width, int height) :
+	surface(Image::Create(width, height)), top(0)
+{
+}
+
+PackedAtlas::~PackedAtlas()
+{
+	delete surface;
+}
+
+int PackedAtlas::Add(Image *image)
+{
+	if (!image) return -1;
+
+	int w = image->GetWidth();
+	int h = image->GetHeight();
+	if (w <= 0 || h <= 0 || w > surface->GetWidth())
+		return -1;
+
+	/* the shelf wasting the fewest rows, or a new one below the others */
+	Shelf *best = nullptr;
+	for (Shelf &shelf : shelves)
+	{
+		if (shelf.height >= h && surface->GetWidth() - shelf.used >= w &&
+			(!best || shelf.height < best->height))
+			best = &shelf;
+	}
+
+	if (!best)
+	{
+		if (surface->GetHeight() - top < h)
+			return -1;
+
+		shelves.push_back({ top, h, 0 });
+		best = &shelves.back();
+		top += h;
+	}
+
+	Rect rc = { best->used, best->y, w, h };
+	best->used += w;
+
+	/* copy the pixels in, the image is not referenced afterwards */
+	const uint32_t *src = image->GetPixels();
+	uint32_t *dst = surface->GetPixels() + (size_t)rc.y * surface->GetStride() + rc.x;
+	for (int row = 0; row < h; row++)
+		memcpy(dst + (size_t)row * surface->GetStride(), src + (size_t)row * image->GetStride(), (size_t)w * sizeof(uint32_t));
+
+	sprites.push_back(rc);
+	return (int)sprites.size() - 1;
+}
+
+Image *PackedAtlas::GetImage()
+{
+	return surface;
+}
+
+bool PackedAtlas::GetSprite(int sprite, Rect *const rect)
+{
+	if (sprite < 0 || sprite >= (int)sprites.size())
+		return false;
+
+	*rect = sprites[sprite];
+	return true;
+}
+
+int PackedAtlas::GetSpriteCount()
+{
+	return (int)sprites.size();
+}
+
+simplegui::SpriteAtlas::SpriteAtlas() { }
+simplegui::SpriteAtlas::~SpriteAtlas() { }
+
+SpriteAtlas *simplegui::SpriteAtlas::Create(int width, int height)
+{
+	return new PackedAtlas(width, height);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <simplegui.h>
+
+#include <vector>
+
+#include "region.h"
+
+//! \brief Sprite atlas packed into shelves: rows of sprites of similar
+//! height, opened from the top of the surface down as they fill up.
+class PackedAtlas : public simplegui::SpriteAtlas
+{
+public:
+	//! \brief A row of the atlas.
+	struct Shelf
+	{
+		int y; // top row
+		int height;
+		int used; // columns taken from the left
+	};
+
+	simplegui::Image *surface;
+	std::vector<simplegui::Rect> sprites; // location of every sprite in the surface
+	std::vector<Shelf> shelves;
+	int top; // first row below the last shelf
+
+	//! \brief Create an empty atlas.
+	//!
+	//! \param [in] width The width of the surface.
+	//! \param [in] height The height of the surface.
+	PackedAtlas(int width, int height);
+	virtual ~PackedAtlas();
+
+	virtual int Add(simplegui::Image *image) override;
+	virtual simplegui::Image *GetImage() override;
+	virtual bool GetSprite(int sprite, simplegui::Rect *const rect) override;
+	virtual int GetSpriteCount() override;
+};
+
+//! \brief The surface and sprite rectangles of an atlas, looked up once for
+//! a batch. Atlases of the library are read directly; other implementations
+//! of SpriteAtlas go through their interface, each sprite once, and their
+//! rectangles are clipped to the surface.
+class SpriteTable
+{
+public:
+	simplegui::Image *image; // the surface, or null
+
+	//! \brief Look up the surface of an atlas.
+	//!
+	//! \param [in] atlas The atlas.
+	SpriteTable(simplegui::SpriteAtlas *atlas) :
+		image(nullptr), atlas(atlas), packed(dynamic_cast<PackedAtlas *>(atlas)), count(0)
+	{
+		if (packed)
+		{
+			image = packed->surface;
+			count = (int)packed->sprites.size();
+			return;
+		}
+
+		image = atlas->GetImage();
+		if (image)
+		{
+			count = atlas->GetSpriteCount();
+			if (count > 0)
+				cache.assign(count, { 0, 0, -1, -1 });
+		}
+	}
+
+	//! \brief Get where a sprite is in the surface.
+	//!
+	//! \param [in] sprite The index of the sprite.
+	//!
+	//! \return The rectangle, or null if there is no such sprite.
+	const simplegui::Rect *Find(int sprite)
+	{
+		if ((unsigned)sprite >= (unsigned)count)
+			return nullptr;
+
+		if (packed)
+			return &packed->sprites[sprite];
+
+		simplegui::Rect &rc = cache[sprite];
+		if (rc.w < 0)
+		{
+			if (!atlas->GetSprite(sprite, &rc))
+				rc = { 0, 0, 0, 0 };
+
+			rc = RectIntersection(rc, { 0, 0, image->GetWidth(), image->GetHeight() });
+		}
+
+		return rc.w > 0 && rc.h > 0 ? &rc : nullptr;
+	}
+
+private:
+	simplegui::SpriteAtlas *atlas;
+	PackedAtlas *packed; // null for other implementations
+	int count;
+	std::vector<simplegui::Rect> cache; // w < 0 until looked up
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+//! \brief Least recently used cache of laid out text runs, keyed by a font
+//! and the text. Lookups do not allocate, so drawing text which is already
+//! cached costs a hash of the string.
+//!
+//! \tparam Run What is cached for each string. Default constructed on
+//! insertion and destroyed on eviction, so it can own resources.
+template <typename Run>
+class TextRunCache
+{
+public:
+	//! \brief Create an empty cache.
+	//!
+	//! \param [in] budget The number of bytes runs may use before the least
+	//! recently used ones are evicted.
+	TextRunCache(size_t budget) :
+		budget(budget), used(0)
+	{
+	}
+
+	//! \brief Find a run and make it the most recently used.
+	//!
+	//! \param [in] font The font key.
+	//! \param [in] text The text.
+	//! \param [in] length The length of the text.
+	//!
+	//! \return The run, or null if it is not cached.
+	Run *Find(uint64_t font, const char *text, size_t length)
+	{
+		auto it = index.find({ font, text, length });
+		if (it == index.end())
+			return nullptr;
+
+		nodes.splice(nodes.begin(), nodes, it->second);
+		return &it->second->run;
+	}
+
+	//! \brief Add a run, evicting the least recently used runs if the cache
+	//! goes over budget. The text must not be cached yet.
+	//!
+	//! \param [in] font The font key.
+	//! \param [in] text The text.
+	//! \param [in] length The length of the text.
+	//! \param [in] bytes The memory the run uses.
+	//!
+	//! \return The new run, to be filled in by the caller.
+	Run *Insert(uint64_t font, const char *text, size_t length, size_t bytes)
+	{
+		nodes.emplace_front();
+		Node &node = nodes.front();
+		node.font = font;
+		node.text.assign(text, length);
+		node.bytes = bytes + length;
+
+		/* the key refers to the copy of the text owned by the node */
+		index[{ font, node.text.data(), node.text.size() }] = nodes.begin();
+		used += node.bytes;
+
+		while (used > budget && nodes.size() > 1)
+			Evict();
+
+		return &node.run;
+	}
+
+	//! \brief Remove all runs.
+	void Clear()
+	{
+		index.clear();
+		nodes.clear();
+		used = 0;
+	}
+
+private:
+	struct Node
+	{
+		uint64_t font;
+		std::string text;
+		size_t bytes;
+		Run run;
+	};
+
+	struct Key
+	{
+		uint64_t font;
+		const char *text; // not terminated
+		size_t length;
+
+		bool operator==(const Key &other) const
+		{
+			return font == other.font && length == other.length &&
+				memcmp(text, other.text, length) == 0;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key &key) const
+		{
+			/* FNV-1a, seeded with the font */
+			uint64_t h = 0xcbf29ce484222325ull ^ (key.font * 0x9e3779b97f4a7c15ull);
+			for (size_t i = 0; i < key.length; i++)
+				h = (h ^ (unsigned char)key.text[i]) * 0x100000001b3ull;
+			return (size_t)h;
+		}
+	};
+
+	std::list<Node> nodes; // most recently used first
+	std::unordered_map<Key, typename std::list<Node>::iterator, KeyHash> index;
+	size_t budget, used;
+
+	void Evict()
+	{
+		Node &node = nodes.back();
+		index.erase({ node.font, node.text.data(), node.text.size() });
+		used -= node.bytes;
+		nodes.pop_back();
+	}
+};
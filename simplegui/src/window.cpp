@@ -1,105 +1,733 @@
 #include <simplegui.h>
 
+using namespace simplegui;
+
+#if defined(_WIN32)
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <list>
+#include <vector>
+
 #include <Windows.h>
 #include <windowsx.h>
 
-using namespace simplegui;
+#include "event_queue.h"
+#include "font_metrics.h"
+#include "frame_stream.h"
+#include "input_state.h"
+#include "memory_graphics.h"
+#include "region.h"
+#include "sprite_atlas.h"
+#include "text_cache.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
 
 static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
 
+//! \brief Read the update region of a window. Must be called before
+//! BeginPaint(), which validates the region.
+//! 
+//! \param [in] hwnd The window.
+//! \param [in] client The client area of the window.
+//! \param [out] region Receives the update region, or the whole client area
+//! if the window has no update region.
+static void ReadUpdateRegion(HWND hwnd, const RECT &client, DirtyRegion &region)
+{
+	region.Clear();
+
+	HRGN rgn = CreateRectRgn(0, 0, 0, 0);
+	if (GetUpdateRgn(hwnd, rgn, FALSE) > NULLREGION)
+	{
+		DWORD size = GetRegionData(rgn, 0, NULL);
+		std::vector<char> buf(size);
+		RGNDATA *data = (RGNDATA *)buf.data();
+
+		if (GetRegionData(rgn, size, data))
+		{
+			RECT *rcs = (RECT *)data->Buffer;
+			for (DWORD i = 0; i < data->rdh.nCount; i++)
+				region.Add({ rcs[i].left, rcs[i].top, rcs[i].right - rcs[i].left, rcs[i].bottom - rcs[i].top });
+		}
+	}
+	DeleteObject(rgn);
+
+	/* forced paint without an update region */
+	if (region.IsEmpty())
+		region.Add({ client.left, client.top, client.right - client.left, client.bottom - client.top });
+}
+
+//! \brief The glyphs of one font, rendered once into a monochrome bitmap.
+//! Copying a glyph to a color device context turns its pixels into the text
+//! and background colors of that context, so one atlas serves every color.
+struct GdiGlyphAtlas
+{
+	LOGFONTA font; // the font the glyphs were rendered with
+	uint64_t id; // identifies the atlas to the run cache, never reused
+	HBITMAP bitmap; // 16 by 16 cells, the cell of character ch is ch % 16, ch / 16
+	int cellWidth, height; // size of a cell
+	int advances[256]; // horizontal distance to the next glyph, per character
+
+	GdiGlyphAtlas() :
+		font(), id(0), bitmap(NULL), cellWidth(0), height(0), advances()
+	{
+	}
+
+	~GdiGlyphAtlas()
+	{
+		if (bitmap)
+			DeleteObject(bitmap);
+	}
+
+	GdiGlyphAtlas(const GdiGlyphAtlas &) = delete;
+	GdiGlyphAtlas &operator=(const GdiGlyphAtlas &) = delete;
+
+	//! \brief Measure the font and render all of its glyphs.
+	//! 
+	//! \param [in] dc Memory device context to render with.
+	//! \param [in] handle The font.
+	//! 
+	//! \return true on success, false if the bitmap could not be created.
+	bool Render(HDC dc, HFONT handle)
+	{
+		HGDIOBJ oldFont = SelectObject(dc, handle);
+
+		TEXTMETRICA tm;
+		GetTextMetricsA(dc, &tm);
+		height = tm.tmHeight;
+
+		if (!GetCharWidth32A(dc, 0, 255, advances))
+		{
+			for (int i = 0; i < 256; i++)
+				advances[i] = tm.tmAveCharWidth;
+		}
+
+		cellWidth = 1;
+		for (int i = 0; i < 256; i++)
+			if (advances[i] > cellWidth)
+				cellWidth = advances[i];
+
+		bitmap = CreateBitmap(16 * cellWidth, 16 * height, 1, 1, NULL);
+		if (!bitmap)
+		{
+			SelectObject(dc, oldFont);
+			return false;
+		}
+
+		/* black glyphs on white, which a copy turns into the text color on
+		the background color */
+		HGDIOBJ oldBitmap = SelectObject(dc, bitmap);
+		SetTextColor(dc, RGB(0, 0, 0));
+		SetBkColor(dc, RGB(255, 255, 255));
+		SetBkMode(dc, OPAQUE);
+
+		for (int i = 0; i < 256; i++)
+		{
+			char ch = (char)i;
+			int x = i % 16 * cellWidth;
+			int y = i / 16 * height;
+			RECT cell = { x, y, x + cellWidth, y + height };
+			ExtTextOutA(dc, x, y, ETO_OPAQUE | ETO_CLIPPED, &cell, &ch, 1, NULL);
+		}
+
+		SelectObject(dc, oldBitmap);
+		SelectObject(dc, oldFont);
+		return true;
+	}
+
+	//! \brief Measure a string, breaking lines like DrawTextA().
+	//! 
+	//! \param [in] string The string.
+	//! \param [in] length The length of the string.
+	//! \param [out] w Receives the width of the longest line.
+	//! \param [out] h Receives the height of all lines.
+	void Measure(const char *string, int length, int *const w, int *const h) const
+	{
+		int lineWidth = 0, lines = 1;
+		*w = 0;
+
+		for (int i = 0; i < length; i++)
+		{
+			unsigned char ch = (unsigned char)string[i];
+			if (ch == '\r' || ch == '\n')
+			{
+				/* a CR LF pair is a single line break */
+				if (ch == '\r' && i + 1 < length && string[i + 1] == '\n')
+					i++;
+				lineWidth = 0;
+				lines++;
+				continue;
+			}
+
+			lineWidth += advances[ch];
+			if (lineWidth > *w)
+				*w = lineWidth;
+		}
+
+		*h = lines * height;
+	}
+};
+
+//! \brief Extent of a string drawn with one atlas.
+struct GdiTextRun
+{
+	int w, h;
+};
+
+//! \brief Test whether two fonts describe the same face, size and style.
+static bool SameFont(const LOGFONTA &a, const LOGFONTA &b)
+{
+	/* the face name is compared up to its terminator, the rest of the array
+	is undefined */
+	return memcmp(&a, &b, offsetof(LOGFONTA, lfFaceName)) == 0 &&
+		strncmp(a.lfFaceName, b.lfFaceName, LF_FACESIZE) == 0;
+}
+
+//! \brief Rendered text of a window, kept across paints. Only touched by the
+//! window thread.
+struct GdiTextCache
+{
+	static constexpr size_t maxAtlases = 16;
+
+	HDC dc; // memory device context the atlases are rendered and drawn with
+	std::list<GdiGlyphAtlas> atlases; // one per font, most recently used first
+	uint64_t nextId;
+	TextRunCache<GdiTextRun> runs; // extents, keyed by atlas id and text
+
+	GdiTextCache() :
+		dc(NULL), nextId(0), runs(1 << 20)
+	{
+	}
+
+	~GdiTextCache()
+	{
+		Release();
+	}
+
+	//! \brief Find the atlas of a font, rendering it the first time the font
+	//! is used. Fonts are identified by what they describe rather than by
+	//! their handle, which may be reused once the font is deleted.
+	//! 
+	//! \param [in] target The device context the text is drawn to.
+	//! \param [in] handle The font.
+	//! 
+	//! \return The atlas, or null if it could not be created.
+	GdiGlyphAtlas *Find(HDC target, HFONT handle)
+	{
+		LOGFONTA font = {};
+		if (!GetObjectA(handle, sizeof(font), &font))
+			return nullptr;
+
+		for (auto it = atlases.begin(); it != atlases.end(); ++it)
+		{
+			if (SameFont(it->font, font))
+			{
+				atlases.splice(atlases.begin(), atlases, it);
+				return &atlases.front();
+			}
+		}
+
+		if (!dc)
+			dc = CreateCompatibleDC(target);
+		if (!dc)
+			return nullptr;
+
+		/* the extents of an evicted atlas are not looked up again */
+		if (atlases.size() >= maxAtlases)
+			atlases.pop_back();
+
+		atlases.emplace_front();
+		GdiGlyphAtlas &atlas = atlases.front();
+		if (!atlas.Render(dc, handle))
+		{
+			atlases.pop_front();
+			return nullptr;
+		}
+
+		atlas.font = font;
+		atlas.id = nextId++;
+		return &atlas;
+	}
+
+	//! \brief Delete all atlases, runs and the device context.
+	void Release()
+	{
+		runs.Clear();
+		atlases.clear();
+		if (dc)
+		{
+			DeleteDC(dc);
+			dc = NULL;
+		}
+	}
+};
+
 class Win32Graphics : public Graphics
 {
 public:
 	PAINTSTRUCT ps;
 	HWND hwnd;
-
-	Win32Graphics(HWND hwnd) :
-		hwnd(hwnd)
+	RECT client; // client area, queried once per paint
+	DirtyRegion dirty; // update region, used to cull primitives
+	Rect clip; // current clipping rectangle
+	std::vector<Rect> clipStack; // rectangles saved by PushClipRect()
+	GdiTextCache *text; // rendered text of the window, optional
+
+	/* segments of DrawLines() with the same color, drawn by one PolyPolyline */
+	std::vector<POINT> segments;
+	std::vector<DWORD> segmentCounts;
+
+	/* state of the device context, so changes which would not change
+	anything are not passed on to GDI */
+	COLORREF penColor, brushColor; // colors of the DC pen and brush, always selected
+	int stretchMode; // 0 until first set
+	GraphicsStats stats;
+
+	Win32Graphics(HWND hwnd, GdiTextCache *text = nullptr) :
+		hwnd(hwnd), text(text), stretchMode(0), stats()
 	{
+		GetClientRect(hwnd, &client);
+		clip = { client.left, client.top, client.right - client.left, client.bottom - client.top };
+
+		ReadUpdateRegion(hwnd, client, dirty);
 		BeginPaint(hwnd, &ps);
+
+		/* the window class has its own device context, which keeps the colors
+		of the last paint. The DC pen and brush start out black and white,
+		like the default pen and brush */
+		SelectObject(ps.hdc, GetStockObject(DC_PEN));
+		SelectObject(ps.hdc, GetStockObject(DC_BRUSH));
+		penColor = GetDCPenColor(ps.hdc);
+		brushColor = GetDCBrushColor(ps.hdc);
 	}
 
-	virtual ~Win32Graphics()
+	//! \brief Change the color of the DC pen, unless it already has it.
+	void SetPenColor(COLORREF color)
 	{
-		Dispose();
+		if (color == penColor)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
+
+		SetDCPenColor(ps.hdc, color);
+		penColor = color;
+		stats.stateChanges++;
 	}
 
-	virtual void DrawRect(int x, int y, int w, int h) override
+	//! \brief Change the color of the DC brush, unless it already has it.
+	void SetBrushColor(COLORREF color)
 	{
-		if (!hwnd) return;
+		if (color == brushColor)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
 
-		MoveToEx(ps.hdc, x, y, NULL);
-		LineTo(ps.hdc, x + w, h);
+		SetDCBrushColor(ps.hdc, color);
+		brushColor = color;
+		stats.stateChanges++;
+	}
 
-		MoveToEx(ps.hdc, x + w, y, NULL);
-		LineTo(ps.hdc, x + w, y + h);
+	//! \brief Change the stretching mode, unless it is already set.
+	void SetStretchMode(int mode)
+	{
+		if (mode == stretchMode)
+		{
+			stats.stateChangesElided++;
+			return;
+		}
 
-		MoveToEx(ps.hdc, x + w, y + h, NULL);
-		LineTo(ps.hdc, x, y + h);
+		SetStretchBltMode(ps.hdc, mode);
+		if (mode == HALFTONE)
+			SetBrushOrgEx(ps.hdc, 0, 0, NULL); // required after switching to halftoning
+		stretchMode = mode;
+		stats.stateChanges++;
+	}
 
-		MoveToEx(ps.hdc, x, y + h, NULL);
-		LineTo(ps.hdc, x, y);
+	//! \brief Test whether any part of a rectangle is inside the clipping
+	//! rectangle and needs repainting.
+	bool Visible(int x, int y, int w, int h)
+	{
+		Rect rc = { x, y, w, h };
+		return RectsOverlap(clip, rc) && dirty.Intersects(rc);
+	}
+
+	//! \brief Select the current clipping rectangle into the device context.
+	void ApplyClip()
+	{
+		HRGN rgn = CreateRectRgn(clip.x, clip.y, clip.x + clip.w, clip.y + clip.h);
+		SelectClipRgn(ps.hdc, rgn);
+		DeleteObject(rgn);
+	}
+
+	virtual ~Win32Graphics()
+	{
+		Dispose();
+	}
 
+	virtual void DrawRect(int x, int y, int w, int h) override
+	{
+		if (!hwnd) return;
+		if (!Visible(x, y, w + 1, h + 1)) return;
+
+		/* one closed polyline, each corner shared by two sides */
+		POINT corners[5] = { { x, y }, { x + w, y }, { x + w, y + h }, { x, y + h }, { x, y } };
+		Polyline(ps.hdc, corners, 5);
 	}
 
 	virtual void FillRect(int x, int y, int w, int h) override
 	{
 		if (!hwnd) return;
+		if (!Visible(x, y, w, h)) return;
 		Rectangle(ps.hdc, x, y, x + w, y + h);
 	}
 
 	virtual void DrawEllipse(int x, int y, int w, int h) override
 	{
 		if (!hwnd) return;
-		Ellipse(ps.hdc, x, y, x + w, y + h);
+		if (!Visible(x, y, w, h)) return;
+
+		/* an arc which ends where it starts is the whole outline, unfilled */
+		Arc(ps.hdc, x, y, x + w, y + h, x, y, x, y);
 	}
 
 	virtual void FillEllipse(int x, int y, int w, int h) override
 	{
 		if (!hwnd) return;
-		Ellipse(ps.hdc, x, y, x + h, y + h);
+		if (!Visible(x, y, w, h)) return;
+		Ellipse(ps.hdc, x, y, x + w, y + h);
 	}
 
 	virtual void DrawLine(int x1, int y1, int x2, int y2) override
 	{
 		if (!hwnd) return;
+		if (!Visible(x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2,
+			(x1 < x2 ? x2 - x1 : x1 - x2) + 1, (y1 < y2 ? y2 - y1 : y1 - y2) + 1)) return;
 
 		MoveToEx(ps.hdc, x1, y1, NULL);
 		LineTo(ps.hdc, x2, y2);
 	}
 
+	//! \brief Copy the glyphs of a string from the atlas selected into the
+	//! text device context, breaking lines like DrawTextA().
+	//! 
+	//! \param [in] atlas The atlas.
+	//! \param [in] x The x position of the string.
+	//! \param [in] y The y position of the string.
+	//! \param [in] string The string.
+	//! \param [in] length The length of the string.
+	//! \param [in] rop The raster operation of the copies.
+	void BlitGlyphs(const GdiGlyphAtlas *atlas, int x, int y, const char *string, int length, DWORD rop)
+	{
+		int penX = x;
+
+		for (int i = 0; i < length; i++)
+		{
+			unsigned char ch = (unsigned char)string[i];
+			if (ch == '\r' || ch == '\n')
+			{
+				if (ch == '\r' && i + 1 < length && string[i + 1] == '\n')
+					i++;
+				penX = x;
+				y += atlas->height;
+				continue;
+			}
+
+			int w = atlas->advances[ch];
+			Rect cell = { penX, y, w, atlas->height };
+			if (w > 0 && RectsOverlap(clip, cell))
+				BitBlt(ps.hdc, penX, y, w, atlas->height, text->dc, ch % 16 * atlas->cellWidth, ch / 16 * atlas->height, rop);
+			penX += w;
+		}
+	}
+
 	virtual void DrawString(int x, int y, const char *string) override
 	{
 		if (!hwnd) return;
 
 		int chCount = (int)strlen(string);
-		SIZE sizl;
+		RECT rc;
+
+		GdiGlyphAtlas *atlas = text ? text->Find(ps.hdc, (HFONT)GetCurrentObject(ps.hdc, OBJ_FONT)) : nullptr;
+		if (!atlas)
+		{
+			int w, h;
+			MeasureString(string, &w, &h);
+			if (!Visible(x, y, w, h)) return;
+
+			rc.left = x;
+			rc.top = y;
+			rc.right = x + w;
+			rc.bottom = y + h;
+
+			/* draw text */
+			DrawTextA(
+				ps.hdc,
+				string,
+				chCount,
+				&rc,
+				DT_LEFT | DT_NOPREFIX);
+			return;
+		}
 
-		/* get extents of text */
-		GetTextExtentPoint32A(
-			ps.hdc,
-			string,
-			chCount,
-			&sizl);
+		/* measure the text only the first time it is drawn with this font */
+		GdiTextRun *run = text->runs.Find(atlas->id, string, chCount);
+		if (!run)
+		{
+			run = text->runs.Insert(atlas->id, string, chCount, sizeof(GdiTextRun));
+			atlas->Measure(string, chCount, &run->w, &run->h);
+		}
 
-		RECT rc;
-		rc.left = x;
-		rc.top = y;
-		rc.right = x + sizl.cx;
-		rc.bottom = y + sizl.cy;
+		if (run->w <= 0 || run->h <= 0) return;
+		if (!Visible(x, y, run->w, run->h)) return;
 
-		/* draw text */
-		DrawTextA(
-			ps.hdc,
-			string,
-			chCount,
-			&rc,
-			DT_LEFT);
+		HGDIOBJ oldBitmap = SelectObject(text->dc, atlas->bitmap);
+
+		if (GetBkMode(ps.hdc) == TRANSPARENT)
+		{
+			/* clear the pixels of the glyphs, then add the text color to them,
+			leaving the pixels around the glyphs as they are */
+			COLORREF color = GetTextColor(ps.hdc);
+			COLORREF background = GetBkColor(ps.hdc);
+
+			SetTextColor(ps.hdc, RGB(0, 0, 0));
+			SetBkColor(ps.hdc, RGB(255, 255, 255));
+			BlitGlyphs(atlas, x, y, string, chCount, SRCAND);
+
+			SetTextColor(ps.hdc, color);
+			SetBkColor(ps.hdc, RGB(0, 0, 0));
+			BlitGlyphs(atlas, x, y, string, chCount, SRCPAINT);
+
+			SetBkColor(ps.hdc, background);
+		}
+		else
+			BlitGlyphs(atlas, x, y, string, chCount, SRCCOPY);
+
+		SelectObject(text->dc, oldBitmap);
+	}
+
+	virtual void DrawImage(Image *image, int x, int y) override
+	{
+		if (!image) return;
+		DrawImage(image, x, y, image->GetWidth(), image->GetHeight(), FILTER_NEAREST);
+	}
+
+	virtual void DrawImage(Image *image, int x, int y, int w, int h, int filter) override
+	{
+		if (!hwnd || !image) return;
+
+		int srcW = image->GetWidth();
+		int srcH = image->GetHeight();
+		if (srcW <= 0 || srcH <= 0 || w <= 0 || h <= 0) return;
+		if (!Visible(x, y, w, h)) return;
+
+		/* the stride is the width of the bitmap, the image its left part */
+		BITMAPINFO bmi = { 0 };
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biWidth = image->GetStride();
+		bmi.bmiHeader.biHeight = -srcH; // top-down
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+
+		/* GDI has no bilinear filter, halftoning averages the source pixels */
+		SetStretchMode(filter == FILTER_BILINEAR && (w != srcW || h != srcH) ? HALFTONE : COLORONCOLOR);
+
+		StretchDIBits(ps.hdc, x, y, w, h, 0, 0, srcW, srcH, image->GetPixels(), &bmi, DIB_RGB_COLORS, SRCCOPY);
+	}
+
+	virtual void DrawSprites(SpriteAtlas *atlas, const SpriteInstance *instances, int count) override
+	{
+		if (!hwnd || !atlas || count <= 0) return;
+
+		SpriteTable table(atlas);
+		if (!table.image) return;
+
+		const uint32_t *src = table.image->GetPixels();
+
+		BITMAPINFO bmi = { 0 };
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biWidth = table.image->GetStride();
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+
+		SetStretchMode(COLORONCOLOR);
+
+		for (int i = 0; i < count; i++)
+		{
+			const SpriteInstance &inst = instances[i];
+			const Rect *found = table.Find(inst.sprite);
+			if (!found)
+				continue;
+
+			const Rect &sprite = *found;
+			if (!Visible(inst.x, inst.y, sprite.w, sprite.h))
+				continue;
+
+			/* the bitmap starts at the top row of the sprite, so the source
+			rectangle never depends on the orientation of the bitmap */
+			bmi.bmiHeader.biHeight = -sprite.h;
+			StretchDIBits(ps.hdc, inst.x, inst.y, sprite.w, sprite.h, sprite.x, 0, sprite.w, sprite.h,
+				src + (size_t)sprite.y * bmi.bmiHeader.biWidth, &bmi, DIB_RGB_COLORS, SRCCOPY);
+		}
+	}
+
+	virtual void FillRects(const ColorRect *rects, int count) override
+	{
+		if (!hwnd || count <= 0) return;
+
+		/* the DC brush changes color without creating objects, and only when
+		the color differs from the previous rectangle */
+		COLORREF fill = brushColor;
+
+		for (int i = 0; i < count; i++)
+		{
+			const ColorRect &rc = rects[i];
+			if (rc.w <= 0 || rc.h <= 0 || !Visible(rc.x, rc.y, rc.w, rc.h))
+				continue;
+
+			SetBrushColor(rc.color.abgr & 0x00ffffff);
+
+			/* the outline has the same color, one pattern fill covers both */
+			PatBlt(ps.hdc, rc.x, rc.y, rc.w, rc.h, PATCOPY);
+		}
+
+		SetBrushColor(fill);
+	}
+
+	virtual void FillEllipses(const ColorRect *ellipses, int count) override
+	{
+		if (!hwnd || count <= 0) return;
+
+		COLORREF line = penColor, fill = brushColor;
+
+		for (int i = 0; i < count; i++)
+		{
+			const ColorRect &rc = ellipses[i];
+			if (rc.w <= 0 || rc.h <= 0 || !Visible(rc.x, rc.y, rc.w, rc.h))
+				continue;
+
+			SetPenColor(rc.color.abgr & 0x00ffffff);
+			SetBrushColor(rc.color.abgr & 0x00ffffff);
+			Ellipse(ps.hdc, rc.x, rc.y, rc.x + rc.w, rc.y + rc.h);
+		}
+
+		SetPenColor(line);
+		SetBrushColor(fill);
+	}
+
+	//! \brief Draw the collected segments with the current pen.
+	void FlushSegments()
+	{
+		if (segmentCounts.empty()) return;
+
+		PolyPolyline(ps.hdc, segments.data(), segmentCounts.data(), (DWORD)segmentCounts.size());
+		segments.clear();
+		segmentCounts.clear();
+	}
+
+	virtual void DrawLines(const ColorLine *lines, int count) override
+	{
+		if (!hwnd || count <= 0) return;
+
+		COLORREF line = penColor;
+
+		/* consecutive lines of the same color are drawn by a single call */
+		for (int i = 0; i < count; i++)
+		{
+			const ColorLine &ln = lines[i];
+			if (!Visible(ln.x1 < ln.x2 ? ln.x1 : ln.x2, ln.y1 < ln.y2 ? ln.y1 : ln.y2,
+				(ln.x1 < ln.x2 ? ln.x2 - ln.x1 : ln.x1 - ln.x2) + 1, (ln.y1 < ln.y2 ? ln.y2 - ln.y1 : ln.y1 - ln.y2) + 1))
+				continue;
+
+			COLORREF color = ln.color.abgr & 0x00ffffff;
+			if (color != penColor)
+				FlushSegments();
+			SetPenColor(color);
+
+			segments.push_back({ ln.x1, ln.y1 });
+			segments.push_back({ ln.x2, ln.y2 });
+			segmentCounts.push_back(2);
+		}
+
+		FlushSegments();
+		SetPenColor(line);
+	}
+
+	virtual void DrawPolyline(const Point *points, int count) override
+	{
+		if (!hwnd || count < 2) return;
+
+		int left = points[0].x, top = points[0].y, right = left, bottom = top;
+		for (int i = 1; i < count; i++)
+		{
+			if (points[i].x < left) left = points[i].x;
+			if (points[i].x > right) right = points[i].x;
+			if (points[i].y < top) top = points[i].y;
+			if (points[i].y > bottom) bottom = points[i].y;
+		}
+
+		if (!Visible(left, top, right - left + 1, bottom - top + 1)) return;
+
+		static_assert(sizeof(Point) == sizeof(POINT), "Point and POINT must have the same layout");
+		Polyline(ps.hdc, (const POINT *)points, count);
+	}
+
+	virtual Font *GetFont() override
+	{
+		return Font::GetSystem();
+	}
+
+	virtual void MeasureString(const char *string, int *const w, int *const h) override
+	{
+		/* the advance table only describes the stock font */
+		if (!hwnd || GetCurrentObject(ps.hdc, OBJ_FONT) == GetStockObject(SYSTEM_FONT))
+		{
+			Font::GetSystem()->MeasureString(string, w, h);
+			return;
+		}
+
+		RECT rc = { 0, 0, 0, 0 };
+		DrawTextA(ps.hdc, string, -1, &rc, DT_LEFT | DT_NOPREFIX | DT_CALCRECT);
+
+		if (w) *w = rc.right;
+		if (h) *h = rc.bottom;
 	}
 
 	virtual void SetClipRect(int x, int y, int w, int h) override
 	{
 		if (!hwnd) return;
+
+		Rect parent = clipStack.empty() ?
+			Rect{ client.left, client.top, client.right - client.left, client.bottom - client.top } :
+			clipStack.back();
+		clip = RectIntersection({ x, y, w, h }, parent);
+		ApplyClip();
+	}
+
+	virtual void PushClipRect(int x, int y, int w, int h) override
+	{
+		if (!hwnd) return;
+
+		clipStack.push_back(clip);
+		clip = RectIntersection({ x, y, w, h }, clip);
+		ApplyClip();
+	}
+
+	virtual void PopClipRect() override
+	{
+		if (!hwnd) return;
+		if (clipStack.empty()) return;
+
+		clip = clipStack.back();
+		clipStack.pop_back();
+		ApplyClip();
 	}
 
 	virtual void SetLineColor(int r, int g, int b) override
@@ -110,8 +738,7 @@ public:
 	virtual void SetLineColor(Color color) override
 	{
 		if (!hwnd) return;
-		SelectObject(ps.hdc, GetStockObject(DC_PEN));
-		SetDCPenColor(ps.hdc, color.abgr);
+		SetPenColor(color.abgr & 0x00ffffff); // GDI has no alpha
 	}
 
 	virtual void SetFillColor(int r, int g, int b) override
@@ -122,8 +749,7 @@ public:
 	virtual void SetFillColor(Color color) override
 	{
 		if (!hwnd) return;
-		SelectObject(ps.hdc, GetStockObject(DC_BRUSH));
-		SetDCBrushColor(ps.hdc, color.abgr);
+		SetBrushColor(color.abgr & 0x00ffffff);
 	}
 
 	virtual void SetColor(int r, int g, int b) override
@@ -137,13 +763,21 @@ public:
 		SetFillColor(color);
 	}
 
+	virtual bool GetColors(Color *const line, Color *const fill) override
+	{
+		if (!hwnd) return false;
+
+		/* the DC pen and brush colors, which have no alpha */
+		if (line) line->abgr = penColor;
+		if (fill) fill->abgr = brushColor;
+		return true;
+	}
+
 	virtual void Clear() override
 	{
 		if (!hwnd) return;
 
-		RECT rc;
-		GetClientRect(hwnd, &rc);
-		::FillRect(ps.hdc, &rc, (HBRUSH)(COLOR_WINDOW + 1));
+		::FillRect(ps.hdc, &client, (HBRUSH)(COLOR_WINDOW + 1));
 	}
 
 	virtual void Dispose() override
@@ -154,10 +788,126 @@ public:
 			hwnd = NULL;
 		}
 	}
+
+	virtual int GetDirtyRects(Rect *const rects, int count) override
+	{
+		return dirty.Copy(rects, count);
+	}
+
+	virtual bool IsDirty(int x, int y, int w, int h) override
+	{
+		return dirty.Intersects({ x, y, w, h });
+	}
+
+	virtual void GetStats(GraphicsStats *const stats) override
+	{
+		*stats = this->stats;
+	}
 };
 
+class Win32Window;
+
+/* messages handled by the dispatcher window, wParam is the window id and
+lParam the Win32Window */
+static constexpr UINT WM_DISPATCHER_ATTACH = WM_APP + 0;
+static constexpr UINT WM_DISPATCHER_DETACH = WM_APP + 1;
+static constexpr UINT WM_DISPATCHER_RESCHEDULE = WM_APP + 2;
+
+//! \brief Thread running the event loop of one or more windows. Windows are
+//! created and destroyed on the thread, and the frames of all paced windows
+//! are driven by a single timer.
+class Dispatcher
+{
+public:
+	//! \brief State of an attached window. Kept in a dense table so the
+	//! event loop can schedule frames without touching the windows.
+	struct Slot
+	{
+		Win32Window *win;
+		HWND hwnd; // stays valid after the window is disposed
+		unsigned id;
+		LONGLONG interval; // counter ticks between frames, 0 when painting on demand
+		LONGLONG nextFrame; // counter value of the next frame
+	};
+
+	HANDLE hThread;
+	HANDLE ready; // signaled once the dispatcher window exists
+	HWND hwnd; // message-only window receiving requests from other threads
+	bool shared; // keeps running when its last window detaches
+	volatile LONG load; // number of windows attached or about to be
+
+	/* only touched by the dispatcher thread */
+	std::vector<Slot> slots;
+	unsigned nextId;
+	HANDLE frameTimer;
+	LARGE_INTEGER clockFrequency;
+	bool retired;
+
+	//! \brief Start a dispatcher thread.
+	//! 
+	//! \param [in] shared Whether the dispatcher serves many windows and runs
+	//! until the process exits.
+	Dispatcher(bool shared);
+
+	//! \brief Wait for the thread to exit. Only for dispatchers which are not
+	//! shared, once their window is detached.
+	~Dispatcher();
+
+	//! \brief Create a window on the dispatcher thread. Returns once the
+	//! window exists.
+	//! 
+	//! \param [in] win The window.
+	void Attach(Win32Window *win);
+
+	//! \brief Destroy a window on the dispatcher thread. Detaching a window
+	//! again does nothing.
+	//! 
+	//! \param [in] win The window.
+	//! \param [in] wait Whether to return only once the window is destroyed.
+	void Detach(Win32Window *win, bool wait);
+
+	//! \brief Pick up a new frame rate of a window.
+	//! 
+	//! \param [in] win The window.
+	void Reschedule(Win32Window *win);
+
+	//! \brief Find the slot of a window.
+	//! 
+	//! \param [in] id The window id.
+	//! 
+	//! \return The slot, or null if the window is not attached.
+	Slot *Find(unsigned id);
+
+	//! \brief Arm the frame timer for the earliest frame. Called by the event
+	//! loop before it waits.
+	//! 
+	//! \return true if any window is paced and the timer is armed.
+	bool ArmFrameTimer();
+
+	//! \brief Run the frames which are due.
+	void RunFrames();
+
+	//! \brief The event loop.
+	void Run();
+
+	//! \brief Entry point for the dispatcher thread.
+	//! 
+	//! \param [in] d The dispatcher.
+	//! 
+	//! \return 0
+	static DWORD CALLBACK Worker(Dispatcher *d);
+
+	//! \brief Window procedure of the dispatcher window.
+	static LRESULT CALLBACK DispatcherProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+};
+
+//! \brief Pick a shared dispatcher for a new window.
+//! 
+//! \return The dispatcher, or null if windows do not share threads.
+static Dispatcher *AcquireSharedDispatcher();
+
 //! \brief Win32 API window
-class Win32Window : public Window
+class Win32Window : public Window, public FrameTarget
 {
 public:
 	friend LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
@@ -195,110 +945,411 @@ public:
 
 		LeaveCriticalSection(&win->cs);
 
-		WakeAllConditionVariable(&win->cv);
 		return win->hwnd;
 	}
 
-	//! \brief The main event loop.
+	HWND hwnd;
+	CRITICAL_SECTION cs;
+	int bgcolor;
+
+	KeyListener *kl;
+	MouseListener *ml;
+	WindowListener *wl;
+	Painter *p;
+	FrameListener *fl;
+
+	Win32Window *parent;
+
+	Dispatcher *dispatcher; // thread running the event loop of the window
+	unsigned id; // identifies the window to its dispatcher
+	HANDLE closed; // signaled once the window is destroyed
+
+	/* frame pacing, the clock is only touched by the dispatcher thread */
+	double frameInterval; // seconds, 0 when painting on demand
+	LARGE_INTEGER clockFrequency;
+	LARGE_INTEGER lastFrame;
+
+	/* invalidations waiting for the next paced frame */
+	DirtyRegion pending;
+	bool pendingAll;
+
+	/* written by the dispatcher thread, read without the lock */
+	InputSnapshot input;
+
+	int mouseMoveMode; // one of MOUSE_MOVE_*
+	std::vector<MouseSample> moves; // collected until they are delivered, only touched by the dispatcher thread
+	MOUSEMOVEPOINT lastMove; // latest batched move, in the format of the mouse history
+	bool tracking; // lastMove is valid and the mouse leaving the window is tracked
+
+	std::atomic<EventQueue *> queue; // created when events are first queued, the dispatcher thread produces
+
+	bool painting;
+
+	/* back buffer, only touched by the window thread */
+	bool doubleBuffered;
+	HDC backDC;
+	HBITMAP backBitmap, oldBitmap;
+	uint32_t *backBits;
+	int backWidth, backHeight; // capacity of the back buffer
+
+	GdiTextCache text; // rendered text, only touched by the window thread
+
+	FrameRing *stream; // presented before the painter runs
+
+	//! \brief Make sure the back buffer can hold the client area. The buffer
+	//! only grows, and does so in steps, so resizing the window does not
+	//! reallocate it on every frame.
 	//! 
-	//! \param [in] win The window.
-	static void EventLoop(Win32Window *win)
+	//! \param [in] w The width of the client area.
+	//! \param [in] h The height of the client area.
+	//! 
+	//! \return true if the buffer was reallocated, in which case its contents
+	//! are undefined.
+	bool ReserveBackBuffer(int w, int h)
 	{
-		BOOL bRet;
-		MSG msg;
+		if (backBits && w <= backWidth && h <= backHeight)
+			return false;
+
+		int newWidth = backWidth + backWidth / 2;
+		int newHeight = backHeight + backHeight / 2;
+		if (newWidth < w) newWidth = w;
+		if (newHeight < h) newHeight = h;
+
+		/* round up to multiples of 16 pixels, rows stay cache line aligned */
+		newWidth = (newWidth + 15) & ~15;
+		newHeight = (newHeight + 15) & ~15;
+
+		ReleaseBackBuffer();
+
+		BITMAPINFO bmi = { 0 };
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biWidth = newWidth;
+		bmi.bmiHeader.biHeight = -newHeight; // top-down
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+
+		void *bits = NULL;
+		backDC = CreateCompatibleDC(NULL);
+		backBitmap = CreateDIBSection(backDC, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+		if (!backBitmap)
+		{
+			DeleteDC(backDC);
+			backDC = NULL;
+			return true;
+		}
+
+		oldBitmap = (HBITMAP)SelectObject(backDC, backBitmap);
+		backBits = (uint32_t *)bits;
+		backWidth = newWidth;
+		backHeight = newHeight;
+		return true;
+	}
 
-		while ((bRet = GetMessageA(&msg, NULL, 0, 0)) != 0)
+	//! \brief Release the back buffer.
+	void ReleaseBackBuffer()
+	{
+		if (backDC)
 		{
-			if (bRet == -1)
-				MessageBoxA(win->hwnd, "Win32Window::EventLoop(): Unresolved Error", "Error", MB_ICONERROR);
+			SelectObject(backDC, oldBitmap);
+			DeleteDC(backDC);
+			backDC = NULL;
+		}
 
-			TranslateMessage(&msg);
-			DispatchMessageA(&msg);
+		if (backBitmap)
+		{
+			DeleteObject(backBitmap);
+			backBitmap = NULL;
+		}
+
+		backBits = nullptr;
+	}
+
+	//! \brief Get the time elapsed since the previous frame and start a new
+	//! frame.
+	//! 
+	//! \param [in] now The current time.
+	//! 
+	//! \return The elapsed time, in seconds.
+	double NextFrameDelta(LARGE_INTEGER now)
+	{
+		double dt = 0;
+		if (lastFrame.QuadPart)
+			dt = (double)(now.QuadPart - lastFrame.QuadPart) / (double)clockFrequency.QuadPart;
+		lastFrame = now;
+		return dt;
+	}
+
+	//! \brief Hand invalidations collected since the last frame to the
+	//! system. Must be called with the critical section held.
+	void SubmitPending()
+	{
+		if (pendingAll)
+		{
+			InvalidateRect(hwnd, NULL, !doubleBuffered);
 		}
+		else
+		{
+			for (int i = 0; i < pending.count; i++)
+			{
+				const Rect &rc = pending.rects[i];
+				RECT r = { rc.x, rc.y, rc.x + rc.w, rc.y + rc.h };
+				InvalidateRect(hwnd, &r, FALSE);
+			}
+		}
+
+		pending.Clear();
+		pendingAll = false;
 	}
 
-	//! \brief Entry point for the window worker.
+	//! \brief Test whether events go to the event queue.
 	//! 
-	//! \param [in] win The window
+	//! \return true if events are queued, false if the listeners are called
+	//! directly.
+	bool QueueingEvents()
+	{
+		EventQueue *q = queue.load(std::memory_order_acquire);
+		return q && q->enabled.load(std::memory_order_relaxed);
+	}
+
+	//! \brief Record an event if events are queued. Called by the
+	//! dispatcher, which is the only producer.
 	//! 
-	//! \return 0
-	static DWORD CALLBACK WindowWorker(Win32Window *win)
+	//! \param [in] type One of EVENT_*.
+	//! \param [in] x The x position or width.
+	//! \param [in] y The y position or height.
+	//! \param [in] code The key, scan code, mouse button or scroll amount.
+	//! \param [in] mod The modifier keys.
+	//! 
+	//! \return true if the event was queued, false if the listeners are to
+	//! be called directly.
+	bool QueueEvent(int type, int x, int y, int code, int mod)
 	{
+		if (!QueueingEvents())
+			return false;
 
-		HWND hwnd;
+		queue.load(std::memory_order_relaxed)->Push({ type, x, y, code, mod });
+		return true;
+	}
 
-		hwnd = SetupWindow(win);
-		EventLoop(win);
-		DestroyWindow(hwnd);
+	//! \brief Record a batched mouse move together with the positions the
+	//! system merged into it. Windows keeps a single WM_MOUSEMOVE in the
+	//! queue and updates it as the mouse moves, so the positions in between
+	//! are read back from the mouse history. Called by the dispatcher.
+	//! 
+	//! \param [in] x The x position, in client coordinates.
+	//! \param [in] y The y position, in client coordinates.
+	//! \param [in] time The message time, in milliseconds.
+	void CollectMouseMove(int x, int y, DWORD time)
+	{
+		POINT pt = { x, y };
+		ClientToScreen(hwnd, &pt);
+
+		/* the history holds 16 bit coordinates */
+		MOUSEMOVEPOINT in = { 0 };
+		in.x = pt.x & 0xFFFF;
+		in.y = pt.y & 0xFFFF;
+		in.time = time;
+
+		/* newest first, starting with this move. Without a previous move
+		   the mouse just entered, and the history is of another window */
+		MOUSEMOVEPOINT history[64];
+		int n = tracking ? GetMouseMovePointsEx(sizeof(in), &in, history, 64, GMMP_USE_DISPLAY_POINTS) : -1;
+
+		size_t first = moves.size();
+		for (int i = 1; i < n; i++)
+		{
+			const MOUSEMOVEPOINT &h = history[i];
+			if ((LONG)(h.time - lastMove.time) < 0 ||
+				(h.time == lastMove.time && h.x == lastMove.x && h.y == lastMove.y))
+				break;
+
+			POINT p = { h.x > 32767 ? h.x - 65536 : h.x, h.y > 32767 ? h.y - 65536 : h.y };
+			ScreenToClient(hwnd, &p);
+			moves.push_back({ (int)p.x, (int)p.y, h.time / 1000.0 });
+		}
+		std::reverse(moves.begin() + first, moves.end());
 
-		return 0;
+		/* message time is in milliseconds and wraps around */
+		moves.push_back({ x, y, time / 1000.0 });
+		lastMove = in;
+
+		if (!tracking)
+		{
+			TRACKMOUSEEVENT tme = { sizeof(tme), TME_LEAVE, hwnd, 0 };
+			tracking = TrackMouseEvent(&tme) != 0;
+		}
 	}
-	
-	HWND hwnd;
-	HANDLE hThread;
-	CRITICAL_SECTION cs;
-	CONDITION_VARIABLE cv;
-	int bgcolor;
 
-	KeyListener *kl;
-	MouseListener *ml;
-	WindowListener *wl;
-	Painter *p;
+	//! \brief Hand collected mouse moves to the mouse listener. Called by
+	//! the dispatcher at the start of a paced frame, once pending input has
+	//! been handled when painting on demand, and before mouse button and
+	//! scroll events.
+	void DeliverMouseMoves()
+	{
+		if (moves.empty())
+			return;
 
-	Win32Window *parent;
+		if (QueueingEvents())
+		{
+			/* a batch becomes one event per position */
+			size_t first = mouseMoveMode == MOUSE_MOVE_BATCHED ? 0 : moves.size() - 1;
+			for (size_t i = first; i < moves.size(); i++)
+				QueueEvent(EVENT_MOUSE_MOVED, moves[i].x, moves[i].y, 0, 0);
+		}
+		else if (ml && mouseMoveMode == MOUSE_MOVE_BATCHED)
+			ml->MouseMovedBatch(this, moves.data(), (int)moves.size());
+		else if (ml)
+			ml->MouseMoved(this, moves.back().x, moves.back().y);
 
-	static constexpr int nKeys = 256;
-	bool keys[nKeys];
+		moves.clear();
+	}
 
-	static constexpr int nMbuttons = 16;
-	bool mbuttons[nMbuttons];
+	//! \brief Read the frame interval after the frame rate changed. Called
+	//! by the dispatcher.
+	//! 
+	//! \return The interval, in seconds, 0 when painting on demand.
+	double ApplyFrameRate()
+	{
+		EnterCriticalSection(&cs);
 
-	bool painting;
+		double interval = frameInterval;
+
+		/* switched to painting on demand, paint what is still pending */
+		if (interval <= 0 && hwnd)
+			SubmitPending();
 
-	int ModifierKeys()
+		LeaveCriticalSection(&cs);
+		return interval;
+	}
+
+	//! \brief Run a paced frame: call the frame listener, then paint what was
+	//! invalidated since the previous frame. Called by the dispatcher.
+	//! 
+	//! \param [in] now The current time.
+	void RunFrame(LARGE_INTEGER now)
 	{
-		int mods = 0;
+		FrameListener *fl;
 
-		if (keys[KEY_LSHIFT]) mods |= MOD_LSHIFT;
-		if (keys[KEY_RSHIFT]) mods |= MOD_RSHIFT;
+		DeliverMouseMoves();
 
-		if (keys[KEY_LMENU]) mods |= MOD_LALT;
-		if (keys[KEY_RMENU]) mods |= MOD_RALT;
+		EnterCriticalSection(&cs);
+		fl = this->fl;
+		LeaveCriticalSection(&cs);
 
-		if (keys[KEY_LWIN]) mods |= MOD_LWIN;
-		if (keys[KEY_RWIN]) mods |= MOD_RWIN;
-		
-		return mods;
+		double dt = NextFrameDelta(now);
+		if (fl)
+			fl->Update(this, dt);
+
+		EnterCriticalSection(&cs);
+		HWND hwnd = this->hwnd;
+		if (hwnd)
+			SubmitPending();
+		LeaveCriticalSection(&cs);
+
+		/* paint synchronously so the frame is presented now */
+		if (hwnd)
+			UpdateWindow(hwnd);
+	}
+
+	//! \brief Draw the latest frame of the frame stream, if there is one.
+	//! 
+	//! \param [in] g The graphics context being painted.
+	//! \param [in] w The width of the client area.
+	//! \param [in] h The height of the client area.
+	void PresentStream(Graphics *g, int w, int h)
+	{
+		Image *frame = stream ? stream->AcquireFrame() : nullptr;
+		if (frame)
+			g->DrawImage(frame, 0, 0, w, h, FILTER_BILINEAR);
+	}
+
+	//! \brief Paint into the back buffer and present the dirty region with a
+	//! single blit.
+	//! 
+	//! \param [in] hwnd The window.
+	void PaintBuffered(HWND hwnd)
+	{
+		RECT client;
+		DirtyRegion region;
+
+		GetClientRect(hwnd, &client);
+		ReadUpdateRegion(hwnd, client, region);
+
+		int w = client.right - client.left;
+		int h = client.bottom - client.top;
+		if (ReserveBackBuffer(w, h))
+		{
+			/* previous contents are gone, repaint everything */
+			region.Clear();
+			region.Add({ 0, 0, w, h });
+		}
+
+		if (backBits)
+		{
+			Color bg;
+			bg.abgr = GetSysColor(COLOR_WINDOW);
+
+			MemoryGraphics g(backBits, w, h, backWidth);
+			g.background = MemoryGraphics::ToPixel(bg);
+			g.SetDirtyRegion(region);
+
+			PresentStream(&g, w, h);
+			if (p)
+				p->Paint(this, &g);
+		}
+
+		/* the system clips the blit to the update region */
+		PAINTSTRUCT ps;
+		BeginPaint(hwnd, &ps);
+		if (backBits)
+		{
+			Rect bounds = region.Bounds();
+			BitBlt(ps.hdc, bounds.x, bounds.y, bounds.w, bounds.h, backDC, bounds.x, bounds.y, SRCCOPY);
+		}
+		EndPaint(hwnd, &ps);
 	}
 
 	Win32Window(int width, int height, const char *title, Win32Window *parent) :
-		hwnd(NULL), hThread(NULL),
-		kl(0), ml(0), wl(0), p(0),
+		hwnd(NULL),
+		kl(0), ml(0), wl(0), p(0), fl(0),
 		bgcolor(RGB(200, 200, 200)),
-		painting(false), parent(parent)
+		parent(parent), dispatcher(nullptr), id(0),
+		frameInterval(0),
+		pendingAll(false),
+		mouseMoveMode(MOUSE_MOVE_IMMEDIATE),
+		lastMove(),
+		tracking(false),
+		queue(nullptr),
+		painting(false),
+		doubleBuffered(false),
+		backDC(NULL), backBitmap(NULL), oldBitmap(NULL),
+		backBits(nullptr), backWidth(0), backHeight(0),
+		stream(nullptr)
 	{
-		/* keys and mouse buttons not pressed initially */
-		ZeroMemory(keys, sizeof(keys));
-		ZeroMemory(mbuttons, sizeof(mbuttons));
+		QueryPerformanceFrequency(&clockFrequency);
+		lastFrame.QuadPart = 0;
 
 		/* create synchronization primitives */
 		InitializeCriticalSection(&cs);
-		InitializeConditionVariable(&cv);
+		closed = CreateEventA(NULL, TRUE, FALSE, NULL);
 
-		/* create worker thread */
-		hThread = CreateThread(
-			NULL,
-			0,
-			(LPTHREAD_START_ROUTINE)&WindowWorker,
-			this,
-			0,
-			NULL);
+		/* children of a shared window run on the same thread, other windows
+		join the shared threads if enabled or get a thread of their own */
+		if (parent && parent->dispatcher->shared)
+		{
+			dispatcher = parent->dispatcher;
+			InterlockedIncrement(&dispatcher->load);
+		}
+		else
+		{
+			dispatcher = AcquireSharedDispatcher();
+			if (!dispatcher)
+				dispatcher = new Dispatcher(false);
+		}
 
-		/* wait for window creation to complete */
-		EnterCriticalSection(&cs);
-		while (!hwnd)
-			SleepConditionVariableCS(&cv, &cs, INFINITE);
-		LeaveCriticalSection(&cs);
+		/* create the window on the dispatcher thread */
+		dispatcher->Attach(this);
 
 		/* set size and title */
 		SetSize(width, height);
@@ -309,14 +1360,15 @@ public:
 	{
 		Dispose();
 
-		/* wait for thread to complete */
-		if (hThread)
-		{
-			WaitForSingleObject(hThread, INFINITE);
-			CloseHandle(hThread);
-			hThread = NULL;
-		}
+		/* destroy the window before it goes away, the dispatcher thread of
+		a window which is not shared exits once it is destroyed */
+		dispatcher->Detach(this, true);
+		if (!dispatcher->shared)
+			delete dispatcher;
+
+		delete queue.load();
 
+		CloseHandle(closed);
 		DeleteCriticalSection(&cs);
 	}
 
@@ -432,18 +1484,65 @@ public:
 		LeaveCriticalSection(&cs);
 	}
 
-	virtual void Repaint() override
+	virtual void Repaint() override
+	{
+		Paint();
+	}
+
+	virtual void Invalidate() override
+	{
+		EnterCriticalSection(&cs);
+
+		/* coalesced until the next frame. The back buffer covers the whole
+		window, so erasing is wasted work when double buffered */
+		if (frameInterval > 0)
+			pendingAll = true;
+		else if (hwnd)
+			InvalidateRect(hwnd, NULL, !doubleBuffered);
+
+		LeaveCriticalSection(&cs);
+	}
+
+	virtual void Invalidate(int x, int y, int w, int h) override
 	{
-		Paint();
+		RECT rc;
+
+		if (w <= 0 || h <= 0)
+			return;
+
+		rc.left = x;
+		rc.top = y;
+		rc.right = x + w;
+		rc.bottom = y + h;
+
+		EnterCriticalSection(&cs);
+
+		/* coalesced until the next frame, otherwise the system accumulates
+		the update region, no erase needed */
+		if (frameInterval > 0)
+			pending.Add({ x, y, w, h });
+		else if (hwnd)
+			InvalidateRect(hwnd, &rc, FALSE);
+
+		LeaveCriticalSection(&cs);
 	}
 
-	virtual void Invalidate() override
+	virtual void SetDoubleBuffered(bool enabled) override
 	{
 		EnterCriticalSection(&cs);
+		doubleBuffered = enabled;
+		LeaveCriticalSection(&cs);
 
-		InvalidateRect(hwnd, NULL, TRUE);
+		Invalidate();
+	}
 
+	virtual Font *GetFont() override
+	{
+		EnterCriticalSection(&cs);
+		bool buffered = doubleBuffered;
 		LeaveCriticalSection(&cs);
+
+		return buffered ? Font::GetBuiltin() : Font::GetSystem();
 	}
 
 	virtual void Validate() override { }
@@ -460,24 +1559,31 @@ public:
 
 	virtual void Wait() override
 	{
-		WaitForSingleObject(hThread, INFINITE);
+		WaitForSingleObject(closed, INFINITE);
 	}
 
 	virtual void Dispose() override
 	{
 		EnterCriticalSection(&cs);
 
+		FrameRing *stream = nullptr;
 		if (hwnd)
 		{
-			PostMessageA(
-				hwnd,
-				WM_QUIT,
-				0,
-				0);
+			dispatcher->Detach(this, false);
 			hwnd = NULL;
+
+			/* wake threads waiting for events */
+			if (EventQueue *q = queue.load())
+				q->Close();
+
+			stream = this->stream;
 		}
 		
 		LeaveCriticalSection(&cs);
+
+		/* outside of the lock, publishing takes it while notifying */
+		if (stream)
+			stream->RemoveTarget(this);
 	}
 
 	virtual bool IsDisposed() override
@@ -516,59 +1622,156 @@ public:
 		LeaveCriticalSection(&cs);
 	}
 
-	virtual bool GetAsyncKey(int vk) override
+	virtual void SetFrameStream(FrameStream *stream) override
 	{
+		/* only streams of the library can notify the window */
+		FrameRing *ring = dynamic_cast<FrameRing *>(stream);
+
 		EnterCriticalSection(&cs);
-		bool r = false;
-		if (vk >= 0 && vk < nKeys)
-			r = keys[vk];
+		FrameRing *old = this->stream;
+		this->stream = ring;
 		LeaveCriticalSection(&cs);
-		return r;
+
+		if (old)
+			old->RemoveTarget(this);
+		if (ring)
+			ring->SetTarget(this);
+
+		Invalidate();
 	}
 
-	virtual void GetAsyncKeys(const int *vks, bool *const states, int count) override
+	virtual void FramePublished() override
 	{
 		EnterCriticalSection(&cs);
-		for (int i = 0; i < count; i++)
-		{
-			int vk = vks[i];
-			if (vk < 1 || vk > nKeys)
-				continue;
-			states[i] = keys[vk];
-		}
+		HWND hwnd = this->hwnd;
 		LeaveCriticalSection(&cs);
+
+		/* the frame covers the client area, no erase needed */
+		RECT rc = { 0, 0, 0, 0 };
+		if (hwnd)
+			GetClientRect(hwnd, &rc);
+		Invalidate(0, 0, rc.right, rc.bottom);
 	}
 
-	virtual bool GetAsyncMouseButton(int mb) override
+	virtual void SetFrameListener(FrameListener *fl) override
 	{
 		EnterCriticalSection(&cs);
-		bool r = false;
-		if (mb >= 1 && mb <= nMbuttons)
-			r = mbuttons[mb - 1];
+		this->fl = fl;
 		LeaveCriticalSection(&cs);
-		return r;
 	}
 
-	virtual void GetAsyncMouseButtons(const int *mbs, bool *const states, int count) override
+	virtual void SetFrameRate(double fps) override
 	{
 		EnterCriticalSection(&cs);
-		for (int i = 0; i < count; i++)
+
+		frameInterval = fps > 0 ? 1.0 / fps : 0;
+
+		/* the dispatcher picks up the new rate */
+		if (hwnd)
+			dispatcher->Reschedule(this);
+
+		LeaveCriticalSection(&cs);
+	}
+
+	virtual void SetMouseMoveMode(int mode) override
+	{
+		EnterCriticalSection(&cs);
+		mouseMoveMode = mode;
+		LeaveCriticalSection(&cs);
+	}
+
+	virtual void SetEventQueue(int capacity, int overflow) override
+	{
+		EnterCriticalSection(&cs);
+
+		EventQueue *q = queue.load(std::memory_order_relaxed);
+		if (q || capacity > 0)
 		{
-			int mb = mbs[i];
-			if (mb < 1 || mb > nMbuttons)
-				continue;
-			states[i] = mbuttons[mb - 1];
+			if (!q)
+				q = new EventQueue(capacity);
+
+			q->overflow.store(overflow, std::memory_order_relaxed);
+			q->enabled.store(capacity > 0, std::memory_order_relaxed);
+			queue.store(q, std::memory_order_release);
 		}
+
 		LeaveCriticalSection(&cs);
 	}
 
+	virtual int PollEvents(Event *const events, int count, int timeout) override
+	{
+		EventQueue *q = queue.load(std::memory_order_acquire);
+		return q ? q->Poll(events, count, timeout) : 0;
+	}
+
+	virtual int DispatchEvents(int timeout) override
+	{
+		static constexpr int batch = 64;
+		Event events[batch];
+		int total = 0;
+
+		for (int n = PollEvents(events, batch, timeout); n > 0; n = PollEvents(events, batch, 0))
+		{
+			EnterCriticalSection(&cs);
+			KeyListener *kl = this->kl;
+			MouseListener *ml = this->ml;
+			WindowListener *wl = this->wl;
+			LeaveCriticalSection(&cs);
+
+			for (int i = 0; i < n; i++)
+				DispatchEvent(this, events[i], kl, ml, wl);
+
+			total += n;
+			if (n < batch)
+				break;
+		}
+
+		return total;
+	}
+
+	virtual void GetEventQueueStats(EventQueueStats *const stats) override
+	{
+		EventQueue *q = queue.load(std::memory_order_acquire);
+		if (q)
+			q->GetStats(stats);
+		else
+			*stats = { 0, 0, 0 };
+	}
+
+	virtual bool GetAsyncKey(int vk) override
+	{
+		return input.GetKey(vk);
+	}
+
+	virtual void GetAsyncKeys(const int *vks, bool *const states, int count) override
+	{
+		for (int i = 0; i < count; i++)
+			states[i] = input.GetKey(vks[i]);
+	}
+
+	virtual bool GetAsyncMouseButton(int mb) override
+	{
+		return input.GetMouseButton(mb);
+	}
+
+	virtual void GetAsyncMouseButtons(const int *mbs, bool *const states, int count) override
+	{
+		for (int i = 0; i < count; i++)
+			states[i] = input.GetMouseButton(mbs[i]);
+	}
+
 	virtual void GetAsyncMousePosition(int *const x, int *const y) override
 	{
 		POINT pPos;
 		GetCursorPos(&pPos);
 		ScreenToClient(hwnd, &pPos);
-		if (*x) *x = pPos.x;
-		if (*y) *y = pPos.y;
+		if (x) *x = pPos.x;
+		if (y) *y = pPos.y;
+	}
+
+	virtual void GetInputState(InputState *const state) override
+	{
+		input.Read(state);
 	}
 
 	virtual Window *CreateChild(int width, int height, const char *title) override
@@ -577,13 +1780,338 @@ public:
 	}
 };
 
+Dispatcher::Dispatcher(bool shared) :
+	hThread(NULL), hwnd(NULL), shared(shared), load(0),
+	nextId(0), frameTimer(NULL), retired(false)
+{
+	QueryPerformanceFrequency(&clockFrequency);
+
+	/* start the thread and wait for its window */
+	ready = CreateEventA(NULL, TRUE, FALSE, NULL);
+	hThread = CreateThread(
+		NULL,
+		0,
+		(LPTHREAD_START_ROUTINE)&Worker,
+		this,
+		0,
+		NULL);
+
+	WaitForSingleObject(ready, INFINITE);
+	CloseHandle(ready);
+	ready = NULL;
+}
+
+Dispatcher::~Dispatcher()
+{
+	WaitForSingleObject(hThread, INFINITE);
+	CloseHandle(hThread);
+}
+
+void Dispatcher::Attach(Win32Window *win)
+{
+	/* sent messages are handled even while the thread runs a modal loop,
+	and directly when called from the dispatcher thread */
+	SendMessageA(hwnd, WM_DISPATCHER_ATTACH, 0, (LPARAM)win);
+}
+
+void Dispatcher::Detach(Win32Window *win, bool wait)
+{
+	if (wait)
+		SendMessageA(hwnd, WM_DISPATCHER_DETACH, win->id, (LPARAM)win);
+	else
+		PostMessageA(hwnd, WM_DISPATCHER_DETACH, win->id, (LPARAM)win);
+}
+
+void Dispatcher::Reschedule(Win32Window *win)
+{
+	PostMessageA(hwnd, WM_DISPATCHER_RESCHEDULE, win->id, (LPARAM)win);
+}
+
+Dispatcher::Slot *Dispatcher::Find(unsigned id)
+{
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].id == id)
+			return &slots[i];
+	}
+	return nullptr;
+}
+
+bool Dispatcher::ArmFrameTimer()
+{
+	LARGE_INTEGER now;
+	LONGLONG next = 0;
+	bool paced = false;
+
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		const Slot &slot = slots[i];
+		if (slot.interval && (!paced || slot.nextFrame < next))
+		{
+			next = slot.nextFrame;
+			paced = true;
+		}
+	}
+
+	if (!paced || !frameTimer)
+		return false;
+
+	QueryPerformanceCounter(&now);
+
+	/* due time is relative and in 100 ns units */
+	LONGLONG remaining = (next - now.QuadPart) * 10000000 / clockFrequency.QuadPart;
+	LARGE_INTEGER due;
+	due.QuadPart = remaining > 0 ? -remaining : -1;
+
+	return SetWaitableTimer(frameTimer, &due, 0, NULL, NULL, FALSE) != 0;
+}
+
+void Dispatcher::RunFrames()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+
+	/* frame listeners may attach or detach windows, so index the table */
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		Slot &slot = slots[i];
+		if (!slot.interval || now.QuadPart < slot.nextFrame)
+			continue;
+
+		/* schedule the next frame, dropping frames if we fell behind */
+		slot.nextFrame += slot.interval;
+		if (slot.nextFrame <= now.QuadPart)
+			slot.nextFrame = now.QuadPart + slot.interval;
+
+		slot.win->RunFrame(now);
+	}
+}
+
+void Dispatcher::Run()
+{
+	MSG msg;
+
+	while (!retired)
+	{
+		bool paced = ArmFrameTimer();
+
+		DWORD r = MsgWaitForMultipleObjectsEx(
+			paced ? 1 : 0,
+			&frameTimer,
+			INFINITE,
+			QS_ALLINPUT,
+			MWMO_INPUTAVAILABLE);
+
+		if (r == WAIT_FAILED)
+			MessageBoxA(NULL, "Dispatcher::Run(): Unresolved Error", "Error", MB_ICONERROR);
+
+		if (paced && r == WAIT_OBJECT_0)
+			RunFrames();
+
+		while (PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessageA(&msg);
+		}
+
+		/* input is handled, deliver the mouse moves it produced. Paced
+		   windows collect them until their next frame */
+		for (size_t i = 0; i < slots.size(); i++)
+			if (!slots[i].interval)
+				slots[i].win->DeliverMouseMoves();
+	}
+}
+
+DWORD CALLBACK Dispatcher::Worker(Dispatcher *d)
+{
+	/* prefer a high resolution timer for frame pacing */
+	d->frameTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!d->frameTimer)
+		d->frameTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+
+	WNDCLASSA wc = { 0 };
+	wc.lpfnWndProc = &DispatcherProc;
+	wc.lpszClassName = "Dispatcher";
+	wc.hInstance = GetModuleHandleA(NULL);
+	RegisterClassA(&wc);
+
+	d->hwnd = CreateWindowExA(
+		0,
+		"Dispatcher",
+		"",
+		0,
+		0, 0, 0, 0,
+		HWND_MESSAGE,
+		NULL,
+		NULL,
+		NULL);
+
+	SetWindowLongPtrA(d->hwnd, GWLP_USERDATA, (LONG_PTR)d);
+	SetEvent(d->ready);
+
+	d->Run();
+
+	DestroyWindow(d->hwnd);
+
+	CloseHandle(d->frameTimer);
+	d->frameTimer = NULL;
+
+	return 0;
+}
+
+LRESULT CALLBACK Dispatcher::DispatcherProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam)
+{
+	Dispatcher *d = (Dispatcher *)GetWindowLongPtrA(hWnd, GWLP_USERDATA);
+	Win32Window *win = (Win32Window *)lParam;
+	Slot *slot;
+
+	switch (Msg)
+	{
+	case WM_DISPATCHER_ATTACH: {
+		win->id = ++d->nextId;
+
+		HWND hwnd = Win32Window::SetupWindow(win);
+		d->slots.push_back({ win, hwnd, win->id, 0, 0 });
+		return 0;
+	}
+
+	case WM_DISPATCHER_DETACH:
+		/* ids are never reused, so a stale request finds nothing */
+		slot = d->Find((unsigned)wParam);
+		if (!slot)
+			return 0;
+
+		{
+			HWND hwnd = slot->hwnd;
+			win = slot->win;
+
+			/* keep the table dense */
+			*slot = d->slots.back();
+			d->slots.pop_back();
+
+			win->ReleaseBackBuffer();
+			win->text.Release();
+			DestroyWindow(hwnd);
+			SetEvent(win->closed);
+		}
+
+		InterlockedDecrement(&d->load);
+		if (!d->shared && d->slots.empty())
+			d->retired = true;
+		return 0;
+
+	case WM_DISPATCHER_RESCHEDULE: {
+		slot = d->Find((unsigned)wParam);
+		if (!slot)
+			return 0;
+
+		double interval = win->ApplyFrameRate();
+
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+
+		slot->interval = interval > 0 ? (LONGLONG)(interval * (double)d->clockFrequency.QuadPart) : 0;
+		if (interval > 0 && slot->interval < 1)
+			slot->interval = 1;
+		slot->nextFrame = now.QuadPart;
+		return 0;
+	}
+	}
+
+	return DefWindowProcA(hWnd, Msg, wParam, lParam);
+}
+
+/* shared dispatchers run until the process exits */
+static constexpr int MAX_SHARED_THREADS = 64;
+static SRWLOCK sharedLock = SRWLOCK_INIT;
+static Dispatcher *sharedDispatchers[MAX_SHARED_THREADS];
+static int sharedDispatcherCount = 0;
+static int sharedThreads = 0; // limit set by Window::SetSharedThreads()
+
+static Dispatcher *AcquireSharedDispatcher()
+{
+	Dispatcher *d = nullptr;
+
+	AcquireSRWLockExclusive(&sharedLock);
+
+	if (sharedThreads > 0)
+	{
+		/* least loaded thread, shared threads beyond a lowered limit take no
+		new windows */
+		int n = sharedDispatcherCount < sharedThreads ? sharedDispatcherCount : sharedThreads;
+		for (int i = 0; i < n; i++)
+		{
+			if (!d || sharedDispatchers[i]->load < d->load)
+				d = sharedDispatchers[i];
+		}
+
+		/* start another thread rather than doubling up */
+		if ((!d || d->load > 0) && sharedDispatcherCount < sharedThreads)
+		{
+			d = new Dispatcher(true);
+			sharedDispatchers[sharedDispatcherCount++] = d;
+		}
+
+		InterlockedIncrement(&d->load);
+	}
+
+	ReleaseSRWLockExclusive(&sharedLock);
+	return d;
+}
+
+//! \brief Measure the stock font windows draw text with.
+//! 
+//! \return The font.
+static TableFont *MeasureSystemFont()
+{
+	TableFont *font = new TableFont();
+
+	HDC dc = CreateCompatibleDC(NULL);
+	HGDIOBJ oldFont = SelectObject(dc, GetStockObject(SYSTEM_FONT));
+
+	TEXTMETRICA tm;
+	GetTextMetricsA(dc, &tm);
+
+	font->metrics.ascent = tm.tmAscent;
+	font->metrics.descent = tm.tmDescent;
+	font->metrics.height = tm.tmHeight;
+	font->metrics.lineHeight = tm.tmHeight; // DrawTextA() leaves out the external leading
+	font->metrics.averageAdvance = tm.tmAveCharWidth;
+	font->metrics.maxAdvance = tm.tmMaxCharWidth;
+
+	if (!GetCharWidth32A(dc, 0, 255, font->advances))
+	{
+		for (int i = 0; i < 256; i++)
+			font->advances[i] = tm.tmAveCharWidth;
+	}
+
+	SelectObject(dc, oldFont);
+	DeleteDC(dc);
+
+	return font;
+}
+
+Font *simplegui::Font::GetSystem()
+{
+	/* never freed, fonts outlive every window */
+	static TableFont *font = MeasureSystemFont();
+	return font;
+}
+
 Window *simplegui::Window::Create(int width, int height, const char *title)
 {
 	return new Win32Window(width, height, title, nullptr);
 }
 
-simplegui::Window::Window() { }
-simplegui::Window::~Window() { }
+void simplegui::Window::SetSharedThreads(int count)
+{
+	if (count < 0) count = 0;
+	if (count > MAX_SHARED_THREADS) count = MAX_SHARED_THREADS;
+
+	AcquireSRWLockExclusive(&sharedLock);
+	sharedThreads = count;
+	ReleaseSRWLockExclusive(&sharedLock);
+}
 
 static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam)
 {
@@ -601,17 +2129,46 @@ static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lP
 		return 0;
 
 	case WM_PAINT: {
-		if (!win->p)
+		if (!win->p && !win->stream)
 			break;
 
-		Win32Graphics g(hWnd);
-		win->p->Paint(win, &g);
+		/* painting on demand, start a frame for this paint */
+		if (win->frameInterval <= 0)
+		{
+			win->DeliverMouseMoves();
+
+			if (win->fl)
+			{
+				LARGE_INTEGER now;
+				QueryPerformanceCounter(&now);
+				win->fl->Update(win, win->NextFrameDelta(now));
+			}
+		}
+
+		if (win->doubleBuffered)
+		{
+			win->PaintBuffered(hWnd);
+			return 0;
+		}
+
+		Win32Graphics g(hWnd, &win->text);
+		win->PresentStream(&g, g.client.right - g.client.left, g.client.bottom - g.client.top);
+		if (win->p)
+			win->p->Paint(win, &g);
 		return 0;
 	}
 
+	case WM_ERASEBKGND:
+		/* the back buffer covers the whole window */
+		if (win && win->doubleBuffered)
+			return 1;
+		break;
+
 	/* window events */
 
 	case WM_CLOSE: // closing
+		if (win->QueueEvent(EVENT_WINDOW_CLOSING, 0, 0, 0, 0))
+			return 0;
 		if (win->wl)
 			win->wl->WindowClosing(win);
 		else
@@ -619,38 +2176,36 @@ static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lP
 		return 0;
 	
 	case WM_SETFOCUS: // gained focus
-		if (win->wl)
+		if (!win->QueueEvent(EVENT_WINDOW_FOCUSED, 0, 0, 0, 0) && win->wl)
 			win->wl->WindowFocused(win);
 		return 0;
 	case WM_KILLFOCUS: // lost focus
-		if (win->wl)
+		if (!win->QueueEvent(EVENT_WINDOW_UNFOCUSED, 0, 0, 0, 0) && win->wl)
 			win->wl->WindowUnfocused(win);
 		return 0;
 	case WM_SIZE: // resized
-		if (win->wl)
+		if (!win->QueueEvent(EVENT_WINDOW_RESIZED, LOWORD(lParam), HIWORD(lParam), 0, 0) && win->wl)
 			win->wl->WindowResized(win, LOWORD(lParam), HIWORD(lParam));
 		return 0;
 	case WM_MOVE: // moved
-		if (win->wl)
+		if (!win->QueueEvent(EVENT_WINDOW_MOVED, LOWORD(lParam), HIWORD(lParam), 0, 0) && win->wl)
 			win->wl->WindowMoved(win, LOWORD(lParam), HIWORD(lParam));
 		return 0;
 
 	/* keyboard events */
 	case WM_KEYDOWN: { // key pressed
-		bool old = win->keys[wParam];
-		win->keys[wParam] = true;
-		if (!old && win->kl)
+		bool old = win->input.SetKey((int)wParam, true);
+		if (!old && !win->QueueEvent(EVENT_KEY_DOWN, 0, 0, (int)wParam, 0) && win->kl)
 			win->kl->KeyDown(win, (int)wParam);
 		return 0;
 	}
 	case WM_CHAR: // key typed
-		if (win->kl)
+		if (!win->QueueEvent(EVENT_KEY_TYPED, 0, 0, (int)wParam, 0) && win->kl)
 			win->kl->KeyTyped(win, (unsigned int)wParam);
 		return 0;
 	case WM_KEYUP: {// key released
-		bool old = win->keys[wParam];
-		win->keys[wParam] = false;
-		if (old && win->kl)
+		bool old = win->input.SetKey((int)wParam, false);
+		if (old && !win->QueueEvent(EVENT_KEY_UP, 0, 0, (int)wParam, 0) && win->kl)
 			win->kl->KeyUp(win, (int)wParam);
 		return 0;
 	}
@@ -662,9 +2217,26 @@ static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lP
 
 	/* mouse events */
 	case WM_MOUSEMOVE:
-		if (win->ml)
+		win->input.SetMousePosition(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+		if (win->mouseMoveMode == MOUSE_MOVE_BATCHED)
+		{
+			win->CollectMouseMove(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam), (DWORD)GetMessageTime());
+			return 0;
+		}
+		if (win->mouseMoveMode == MOUSE_MOVE_COALESCED)
+		{
+			/* only the latest position is delivered */
+			win->moves.clear();
+			win->moves.push_back({ GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam), (DWORD)GetMessageTime() / 1000.0 });
+			return 0;
+		}
+		if (!win->QueueEvent(EVENT_MOUSE_MOVED, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam), 0, 0) && win->ml)
 			win->ml->MouseMoved(win, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
 		return 0;
+	case WM_MOUSELEAVE:
+		/* the next batched move starts without history */
+		win->tracking = false;
+		return 0;
 	case WM_LBUTTONDOWN:
 		evt.button = 1;
 		goto mb_down_generic;
@@ -674,15 +2246,14 @@ static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lP
 	case WM_MBUTTONDOWN:
 		evt.button = 3;
 	mb_down_generic:
-		win->mbuttons[evt.button - 1] = true;
-		if (win->ml)
-		{
-			evt.count = 0;
-			evt.mod = win->ModifierKeys();
-			evt.x = GET_X_LPARAM(lParam);
-			evt.y = GET_Y_LPARAM(lParam);
+		win->DeliverMouseMoves();
+		win->input.SetMouseButton(evt.button, true);
+		evt.count = 0;
+		evt.mod = win->input.ModifierKeys();
+		evt.x = GET_X_LPARAM(lParam);
+		evt.y = GET_Y_LPARAM(lParam);
+		if (!win->QueueEvent(EVENT_MOUSE_DOWN, evt.x, evt.y, evt.button, evt.mod) && win->ml)
 			win->ml->MouseDown(win, evt);
-		}
 		return 0;
 	// TODO: clicks
 	
@@ -695,22 +2266,24 @@ static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lP
 	case WM_MBUTTONUP:
 		evt.button = 3;
 	mb_up_generic:
-		win->mbuttons[evt.button - 1] = false;
-		if (win->ml)
-		{
-			evt.count = 0;
-			evt.mod = 0;
-			evt.x = GET_X_LPARAM(lParam);
-			evt.y = GET_Y_LPARAM(lParam);
+		win->DeliverMouseMoves();
+		win->input.SetMouseButton(evt.button, false);
+		evt.count = 0;
+		evt.mod = 0;
+		evt.x = GET_X_LPARAM(lParam);
+		evt.y = GET_Y_LPARAM(lParam);
+		if (!win->QueueEvent(EVENT_MOUSE_UP, evt.x, evt.y, evt.button, evt.mod) && win->ml)
 			win->ml->MouseUp(win, evt);
-		}
 		return 0;
 	case WM_MOUSEWHEEL: {
+		win->DeliverMouseMoves();
+		if (win->QueueEvent(EVENT_MOUSE_SCROLL, 0, 0, WHEEL_DELTA * GET_WHEEL_DELTA_WPARAM(wParam), 0))
+			return 0;
 		if (win->ml)
 		{
 			evt.count = 0;
 			evt.mod = 0;
-			evt.mod = win->ModifierKeys();
+			evt.mod = win->input.ModifierKeys();
 			evt.x = GET_X_LPARAM(lParam);
 			evt.y = GET_Y_LPARAM(lParam);
 			win->ml->MouseScroll(win, WHEEL_DELTA * GET_WHEEL_DELTA_WPARAM(wParam));
@@ -720,4 +2293,26 @@ static LRESULT CALLBACK WindowProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lP
 	}
 
 	return DefWindowProcA(hWnd, Msg, wParam, lParam);
-}
\ No newline at end of file
+}
+
+#else
+
+/* no native window system, fall back to a headless window */
+Window *simplegui::Window::Create(int width, int height, const char *title)
+{
+	return HeadlessWindow::Create(width, height, title);
+}
+
+/* headless windows draw all text with the built-in font */
+Font *simplegui::Font::GetSystem()
+{
+	return Font::GetBuiltin();
+}
+
+/* headless windows have no event loop */
+void simplegui::Window::SetSharedThreads(int count) { }
+
+#endif
+
+simplegui::Window::Window() { }
+simplegui::Window::~Window() { }
@@ -0,0 +1,164 @@
+#include "worker_pool.h"
+
+static inline uint64_t MakeRange(uint32_t begin, uint32_t end)
+{
+	return ((uint64_t)begin << 32) | end;
+}
+
+WorkerPool *WorkerPool::Get()
+{
+	static WorkerPool pool((int)std::thread::hardware_concurrency() - 1);
+	return &pool;
+}
+
+WorkerPool::WorkerPool(int workers) :
+	generation(0), participants(0), task(nullptr), stopping(false), active(0)
+{
+	if (workers < 0)
+		workers = 0;
+
+	shares.reset(new Share[workers + 1]);
+	for (int i = 0; i <= workers; i++)
+		shares[i].range.store(0, std::memory_order_relaxed);
+
+	for (int i = 0; i < workers; i++)
+		threads.emplace_back(&WorkerPool::Loop, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread &t : threads)
+		t.join();
+}
+
+int WorkerPool::Next(int self)
+{
+	std::atomic<uint64_t> &own = shares[self].range;
+
+	for (;;)
+	{
+		/* front of the own share */
+		uint64_t r = own.load(std::memory_order_acquire);
+		while ((uint32_t)(r >> 32) < (uint32_t)r)
+		{
+			if (own.compare_exchange_weak(r, r + ((uint64_t)1 << 32), std::memory_order_acq_rel))
+				return (int)(r >> 32);
+		}
+
+		/* the back half of the largest share of another thread */
+		int victim = -1;
+		uint32_t most = 0;
+		for (int i = 0; i < participants; i++)
+		{
+			uint64_t v = shares[i].range.load(std::memory_order_relaxed);
+			uint32_t left = (uint32_t)v - (uint32_t)(v >> 32);
+			if (i != self && (uint32_t)(v >> 32) < (uint32_t)v && left > most)
+			{
+				victim = i;
+				most = left;
+			}
+		}
+
+		if (victim < 0)
+			return -1;
+
+		std::atomic<uint64_t> &other = shares[victim].range;
+		uint64_t v = other.load(std::memory_order_acquire);
+		uint32_t begin = (uint32_t)(v >> 32);
+		uint32_t end = (uint32_t)v;
+		if (begin >= end)
+			continue;
+
+		/* with a single task left, the thief takes it */
+		uint32_t mid = begin + (end - begin) / 2;
+		if (!other.compare_exchange_strong(v, MakeRange(begin, mid), std::memory_order_acq_rel))
+			continue;
+
+		/* nobody steals from an empty share, so it can be replaced */
+		own.store(MakeRange(mid + 1, end), std::memory_order_release);
+		return (int)mid;
+	}
+}
+
+void WorkerPool::Work(int self)
+{
+	for (int i = Next(self); i >= 0; i = Next(self))
+		(*task)(i);
+}
+
+void WorkerPool::Loop(int self)
+{
+	uint64_t seen = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || (generation != seen && self < participants - 1); });
+
+			if (stopping)
+				return;
+
+			seen = generation;
+		}
+
+		Work(self);
+		active.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+void WorkerPool::Run(int count, int parallelism, const std::function<void(int)> &fn)
+{
+	if (count <= 0)
+		return;
+
+	int n = GetThreadCount();
+	if (parallelism > 0 && parallelism < n)
+		n = parallelism;
+	if (n > count)
+		n = count;
+
+	std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+	if (n <= 1 || !running.owns_lock())
+	{
+		for (int i = 0; i < count; i++)
+			fn(i);
+		return;
+	}
+
+	/* the caller takes the last share, workers the ones before it */
+	int self = n - 1;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (int i = 0; i < n; i++)
+		{
+			uint32_t begin = (uint32_t)((int64_t)count * i / n);
+			uint32_t end = (uint32_t)((int64_t)count * (i + 1) / n);
+			shares[i].range.store(MakeRange(begin, end), std::memory_order_relaxed);
+		}
+
+		participants = n;
+		task = &fn;
+		active.store(n - 1, std::memory_order_relaxed);
+		generation++;
+	}
+	wake.notify_all();
+
+	Work(self);
+
+	/* every task has been taken once the caller runs out, but workers may
+	still be running theirs, and must not look at the next batch early */
+	while (active.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	participants = 0;
+	task = nullptr;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! \brief Pool of threads running batches of independent tasks, shared by
+//! the whole process.
+//!
+//! Every thread taking part in a batch starts with an equal share of the
+//! tasks, takes them from the front of its share and, once it runs out,
+//! steals the back half of the largest remaining share. Tasks which take
+//! longer than others do not hold up the batch.
+class WorkerPool
+{
+public:
+	//! \brief Get the shared pool, with one thread per processor besides
+	//! the caller. Started on first use.
+	//!
+	//! \return The pool.
+	static WorkerPool *Get();
+
+	//! \brief Create a pool.
+	//!
+	//! \param [in] workers The number of threads besides the caller.
+	WorkerPool(int workers);
+
+	//! \brief Stop the threads.
+	~WorkerPool();
+
+	//! \brief Get the number of threads which can run a batch, including the
+	//! caller.
+	//!
+	//! \return The number of threads.
+	int GetThreadCount() const
+	{
+		return (int)threads.size() + 1;
+	}
+
+	//! \brief Run tasks and return once all of them have finished. The
+	//! caller runs tasks too. If another batch is running, the caller runs
+	//! all tasks by itself.
+	//!
+	//! \param [in] count The number of tasks.
+	//! \param [in] parallelism The maximum number of threads, including the
+	//! caller, or 0 for all of them.
+	//! \param [in] task Called with the index of each task, from any of the
+	//! threads.
+	void Run(int count, int parallelism, const std::function<void(int)> &task);
+
+private:
+	//! \brief Tasks a thread has yet to run, the first in the high half and
+	//! one past the last in the low half. Other threads steal from the back.
+	struct alignas(64) Share
+	{
+		std::atomic<uint64_t> range;
+	};
+
+	std::vector<std::thread> threads;
+	std::unique_ptr<Share[]> shares; // one per thread, the caller's last
+
+	std::mutex runMutex; // held by the caller of the running batch
+
+	/* the running batch, changed under mutex while no worker takes part */
+	std::mutex mutex;
+	std::condition_variable wake;
+	uint64_t generation; // incremented for every batch
+	int participants; // threads taking part in the batch, including the caller
+	const std::function<void(int)> *task;
+	bool stopping;
+
+	std::atomic<int> active; // workers still looking for tasks of the batch
+
+	//! \brief Take a task from the own share, or steal from another one.
+	//!
+	//! \param [in] self The share of the thread.
+	//!
+	//! \return The task, or -1 if none are left.
+	int Next(int self);
+
+	//! \brief Run tasks of the batch until none are left.
+	//!
+	//! \param [in] self The share of the thread.
+	void Work(int self);
+
+	//! \brief Body of the worker threads.
+	//!
+	//! \param [in] self The share of the thread.
+	void Loop(int self);
+};
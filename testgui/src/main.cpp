@@ -2,7 +2,6 @@
 
 #include <cmath>
 #include <string>
-#include <Windows.h>
 
 using namespace simplegui;
 int offset;
@@ -12,33 +11,47 @@ std::string text;
 class MyPainter : public Painter
 {
 public:
+	DisplayList *chrome; // static content, recorded on the first paint
+
+	MyPainter() :
+		chrome(DisplayList::Create()) { }
+
+	virtual ~MyPainter()
+	{
+		delete chrome;
+	}
+
 	virtual void Paint(Window *window, Graphics *g) override
 	{
-		g->Clear();
+		if (chrome->IsEmpty())
+		{
+			chrome->Clear();
 
-		g->SetColor(Color(255, 0, 0));
-		g->FillRect(100, 100, 200, 200);
+			chrome->SetColor(Color(255, 0, 0));
+			chrome->FillRect(100, 100, 200, 200);
 
+			chrome->DrawString(100, 100, "Hello World!");
 
+			chrome->SetColor(Color::BLACK);
+			chrome->FillRect(100, 216, 300, 2);
 
+			chrome->SetFillColor(Color::GREEN);
+			chrome->SetLineColor(Color::DARK_GREEN);
+			chrome->FillRect(10, 10, 50, 10);
+		}
 
-		g->DrawString(100, 100, "Hello World!");
+		chrome->Replay(g);
 
 		g->SetColor(Color::BLACK);
-		g->FillRect(100, 216, 300, 2);
 		g->DrawString(100, 200, text.c_str());
 		
-		g->SetFillColor(Color::GREEN);
-		g->SetLineColor(Color::DARK_GREEN);
-		g->FillRect(10, 10, 50, 10);
-		
 		g->SetFillColor(Color::LIGHT_AQUA);
 		g->SetLineColor(Color::AQUA);
-		g->DrawEllipse(150 + offset, 20, 40, 100);
+		g->FillEllipse(150 + offset, 20, 40, 100);
 
 		g->SetFillColor(Color::RED);
 		g->SetLineColor(Color::DARK_RED);
-		g->DrawEllipse(lastX - 10, lastY - 10, 20, 20);
+		g->FillEllipse(lastX - 10, lastY - 10, 20, 20);
 	}
 };
 
@@ -55,6 +68,19 @@ public:
 	}
 };
 
+class MyFrameListener : public FrameListener
+{
+public:
+	double time = 0;
+
+	virtual void Update(Window *win, double dt) override
+	{
+		time += dt;
+		offset = (int)(sin(time) * 50);
+		win->Invalidate();
+	}
+};
+
 class MyKeyListener : public KeyListener
 {
 public:
@@ -90,22 +116,17 @@ int main(int argc, char *argv[])
 	MyPainter painter;
 	MyMouseListener mListener;
 	MyKeyListener kListener;
+	MyFrameListener fListener;
 
 	Window *window = Window::Create(800, 600, "Hello Window!"); // create the window
 	window->SetPainter(&painter); // set the painter
 	window->SetMouseListener(&mListener);
 	window->SetKeyListener(&kListener);
+	window->SetFrameListener(&fListener);
+	window->SetFrameRate(50); // animate at 50 frames per second
+	window->SetDoubleBuffered(true); // animated, avoid flicker
 	window->Show(true); // show the window
 
-	while (!window->IsDisposed())
-	{
-		double time = (double)GetTickCount64();
-		offset = (int)(sin(time / 1000.0) * 50);
-
-		Sleep(20);
-		window->Invalidate();
-	}
-
 	window->Wait();  // wait for the window to close
 	delete window;  // delete the window
 